@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/utils/NumberOperation.h"
+#include "src/utils/ThreadPool.h"
+
+#include "src/CPU.h"
+
+// Runs many programs in one process, one CPU per task on a pool of worker threads, and prints one line per program in
+// the order given: name, output, cycles, committed instructions, branch prediction accuracy and the share of
+// speculative loads that were replayed.
+// Options: -j n sets the number of threads (default: number of cores), --dir=path runs every .data file in path
+// (default: testcases when no file is given), the options of Config::ParseArgument() configure every CPU, and any other
+// argument is a .data file to run.
+struct BatchResult {
+  std::string name;
+  uint32_t output = 0, cycle_cnt = 0;
+  uint64_t commit_cnt = 0;
+  double accuracy = 0, violation_rate = 0;
+};
+
+int main(int argc, char *argv[]) {
+  unsigned thread_cnt = std::thread::hardware_concurrency();
+  std::vector<std::string> paths;
+  std::string dir;
+  bubble::Config config;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      if (!bubble::ParseNumber(argv[++i], thread_cnt)) {
+        std::cerr << "invalid option -j " << argv[i] << "\n";
+        return 1;
+      }
+    }
+    else if (arg.rfind("--dir=", 0) == 0) {
+      dir = arg.substr(6);
+    }
+    else if (arg.rfind("--", 0) == 0) {
+      if (!config.ParseArgument(arg)) {
+        std::cerr << "invalid option " << arg << "\n";
+        return 1;
+      }
+    }
+    else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty() && dir.empty()) {
+    dir = "testcases";
+  }
+  if (!dir.empty()) {
+    std::vector<std::string> dir_paths;
+    for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+      if (entry.path().extension() == ".data") {
+        dir_paths.push_back(entry.path().string());
+      }
+    }
+    std::sort(dir_paths.begin(), dir_paths.end());
+    paths.insert(paths.end(), dir_paths.begin(), dir_paths.end());
+  }
+  for (const auto &path : paths) {
+    if (!std::filesystem::is_regular_file(path)) {
+      std::cerr << "cannot open " << path << "\n";
+      return 1;
+    }
+  }
+  std::vector<BatchResult> results(paths.size());
+  {
+    bubble::ThreadPool pool(thread_cnt);
+    for (std::size_t i = 0; i < paths.size(); i++) {
+      pool.Submit([&path = paths[i], &result = results[i], &config]() {
+        bubble::CPU cpu(config);
+        cpu.LoadMemory(path);
+        cpu.clock_.Run();
+        while (!cpu.ShouldHalt()) {
+          cpu.Step();
+        }
+        result.name = std::filesystem::path(path).stem().string();
+        result.output = cpu.Halt();
+        result.cycle_cnt = cpu.clock_.GetCycleCount();
+        result.commit_cnt = cpu.rb_.GetCommitCount();
+        result.accuracy = cpu.bp_.GetAccuracy();
+        result.violation_rate = cpu.ssp_.GetViolationRate();
+      });
+    }
+  }
+  for (const auto &result : results) {
+    std::cout << std::left << std::setw(16) << result.name << std::right << std::setw(4) << result.output
+              << std::setw(12) << result.cycle_cnt << std::setw(12) << result.commit_cnt << std::fixed
+              << std::setprecision(4) << std::setw(8) << result.accuracy << std::setw(8) << result.violation_rate
+              << "\n";
+  }
+  return 0;
+}
@@ -1,35 +1,144 @@
 #include <iomanip>
 #include <iostream>
+#include <random>
+#include <string>
+#include <utility>
 
 #include "src/CPU.h"
+#include "src/utils/NumberOperation.h"
 
-int main() {
+// Options: --order-fuzz[=seed] calls the units in a seeded random order every cycle to check that the result does not
+// depend on it. The seed is logged to stderr so that a failing run can be reproduced.
+// --fast-forward=n executes the first n instructions functionally and --fast-forward-to=addr (hex) executes up to the
+// instruction at addr functionally; the out-of-order pipeline takes over from there.
+// --save-checkpoint=path together with --checkpoint-cycle=n saves the state of the CPU to path once n cycles have
+// passed, and --load-checkpoint=path resumes from such a checkpoint instead of reading a program.
+// --config=path reads the sizes and latencies of the core from a file and --rob-size=n, --rs-size=n, --lsb-size=n,
+// --inst-queue-size=n, --ftq-size=n, --fetch-btb-size=n, --fetch-width=n, --dispatch-width=n, --commit-width=n,
+// --alu-cnt=n, --alu-latency=n, --alu-pipelined=0|1, --branch-unit-cnt=n, --branch-latency=n, --branch-pipelined=0|1,
+// --cdb-width=n, --memory-latency=n, --mshr-cnt=n, --bp-type=name, --bp-size=n, --bp-history=n, --btb-size=n,
+// --indirect-size=n, --ras-size=n, --ssit-size=n, --lfst-size=n, --store-buffer-size=n and the cache parameters of
+// Config (e.g. --l1d-size=n) set them one by one. The hits and misses of the caches in use are reported on stderr.
+int main(int argc, char *argv[]) {
   uint32_t output;
+  bool order_fuzz = false;
+  uint32_t order_fuzz_seed = 0;
+  uint64_t fast_forward_cnt = 0;
+  uint32_t fast_forward_pc = UINT32_MAX;
+  std::string save_checkpoint_path, load_checkpoint_path;
+  uint32_t checkpoint_cycle = 0;
+  bubble::Config config;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool valid = true;
+    if (arg == "--order-fuzz") {
+      order_fuzz = true;
+      order_fuzz_seed = std::random_device()();
+    }
+    else if (arg.rfind("--order-fuzz=", 0) == 0) {
+      order_fuzz = true;
+      valid = bubble::ParseNumber(arg.substr(13), order_fuzz_seed);
+    }
+    else if (arg.rfind("--fast-forward=", 0) == 0) {
+      valid = bubble::ParseNumber(arg.substr(15), fast_forward_cnt);
+    }
+    else if (arg.rfind("--fast-forward-to=", 0) == 0) {
+      fast_forward_cnt = UINT64_MAX;
+      valid = bubble::ParseNumber(arg.substr(18), fast_forward_pc, 16);
+    }
+    else if (arg.rfind("--save-checkpoint=", 0) == 0) {
+      save_checkpoint_path = arg.substr(18);
+    }
+    else if (arg.rfind("--checkpoint-cycle=", 0) == 0) {
+      valid = bubble::ParseNumber(arg.substr(19), checkpoint_cycle);
+    }
+    else if (arg.rfind("--load-checkpoint=", 0) == 0) {
+      load_checkpoint_path = arg.substr(18);
+    }
+    else {
+      valid = config.ParseArgument(arg);
+    }
+    if (!valid) {
+      std::cerr << "invalid option " << arg << "\n";
+      return 1;
+    }
+  }
 #ifdef _DEBUG
-  bubble::CPU cpu("pc.txt", "pc_with_cycle.txt");
-  cpu.LoadMemory("../testcases/pi.data");
+  bubble::CPU cpu("pc.txt", "pc_with_cycle.txt", config);
+  if (load_checkpoint_path.empty()) {
+    cpu.LoadMemory("../testcases/pi.data");
+  }
   freopen("debug.txt", "w", stdout);
   std::cout << std::boolalpha;
 #else
-  bubble::CPU cpu;
-  cpu.LoadMemory();
+  bubble::CPU cpu(config);
+  if (load_checkpoint_path.empty()) {
+    cpu.LoadMemory();
+  }
 #endif
+  if (!load_checkpoint_path.empty() && !cpu.LoadCheckpoint(load_checkpoint_path)) {
+    std::cerr << "cannot load checkpoint " << load_checkpoint_path << "\n";
+    return 1;
+  }
+  if (order_fuzz) {
+    cpu.EnableOrderFuzz(order_fuzz_seed);
+  }
+  if (fast_forward_cnt != 0) {
+    std::clog << "fast-forward: " << cpu.FastForward(fast_forward_cnt, fast_forward_pc) << " instructions\n";
+  }
   cpu.clock_.Run();
+  auto save_checkpoint = [&]() {
+    if (!save_checkpoint_path.empty() && cpu.clock_.GetCycleCount() >= checkpoint_cycle) {
+      if (cpu.SaveCheckpoint(save_checkpoint_path)) {
+        std::clog << "checkpoint saved at cycle " << cpu.clock_.GetCycleCount() << "\n";
+      }
+      else {
+        std::cerr << "cannot save checkpoint " << save_checkpoint_path << "\n";
+      }
+      save_checkpoint_path.clear();
+    }
+  };
+#ifdef _DEBUG
   while (!cpu.ShouldHalt()) {
+    save_checkpoint();
     cpu.Update();
-#ifdef _DEBUG
     cpu.Debug();
-#endif
     cpu.Execute();
     cpu.Write();
     cpu.clock_.Tick();
   }
+#else
+  while (!cpu.ShouldHalt()) {
+    save_checkpoint();
+    if (order_fuzz) {
+      cpu.Update();
+      cpu.Execute();
+      cpu.Write();
+      cpu.clock_.Tick();
+      continue;
+    }
+    cpu.Step();
+  }
+#endif
   output = cpu.Halt();
+  // The output has to be the only thing on stdout, so the cache statistics go to stderr.
+  std::pair<const char *, const bubble::Cache *> caches[] = {{"L1I", &cpu.memory_.GetL1ICache()},
+                                                             {"L1D", &cpu.memory_.GetL1DCache()},
+                                                             {"L2", &cpu.memory_.GetL2Cache()}};
+  for (const auto &cache : caches) {
+    if (cache.second->IsEnabled()) {
+      std::clog << cache.first << " hits: " << cache.second->GetHitCount() << ", misses: "
+                << cache.second->GetMissCount() << "\n";
+    }
+  }
 #ifdef _DEBUG
   freopen("/dev/tty", "w", stdout);
   std::cout << "output: " << output << "\n";
   std::cout << "clock cycle count: " << cpu.clock_.GetCycleCount() << "\n";
   std::cout << "accuracy of branch prediction: " << cpu.bp_.GetAccuracy() << "\n";
+  std::cout << "accuracy of jump target prediction: " << cpu.bp_.GetTargetAccuracy() << "\n";
+  std::cout << "accuracy of return prediction: " << cpu.bp_.GetReturnAccuracy() << "\n";
+  std::cout << "memory dependence violation rate: " << cpu.ssp_.GetViolationRate() << "\n";
 #else
   std::cout << output;
 #endif
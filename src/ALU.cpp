@@ -1,16 +1,73 @@
 #include <iostream>
 
 #include "ALU.h"
+#include "Memory.h"
 #include "ReorderBuffer.h"
 #include "ReservationStation.h"
 
 namespace bubble {
 
-ALU::ALU(const Clock &clock) : output_(), wc_(clock) {}
+CommonDataBus::CommonDataBus(const MemoryOutput &from_mem, const std::array<ALUOutput, kMaxCDBWidth - 1> &from_alu,
+                             int alu_slot_cnt) :
+    from_mem_(&from_mem), from_alu_(&from_alu), alu_slot_cnt_(alu_slot_cnt) {}
+
+bool CommonDataBus::HasResult() const {
+  if (from_mem_->done_) {
+    return true;
+  }
+  for (int i = 0; i < alu_slot_cnt_; i++) {
+    if ((*from_alu_)[i].done_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CommonDataBus::Find(int id, uint32_t &val) const {
+  if (from_mem_->done_ && from_mem_->id_ == id) {
+    val = from_mem_->val_;
+    return true;
+  }
+  for (int i = 0; i < alu_slot_cnt_; i++) {
+    if ((*from_alu_)[i].done_ && (*from_alu_)[i].id_ == id) {
+      val = (*from_alu_)[i].val_;
+      return true;
+    }
+  }
+  return false;
+}
+
+ALU::ALU(const Clock &clock, const Config &config) :
+    output_(), wc_(clock), pipeline_(), head_(0), in_flight_cnt_(0),
+    port_cnt_(config.alu_cnt_ + config.branch_unit_cnt_), alu_slot_cnt_(config.cdb_width_ - 1) {}
 
 void ALU::Debug() const {
   std::cout << "ALU:\n";
-  std::cout << "\toutput_ = " << output_.GetCur().ToString() << "\n\n";
+  for (int i = 0; i < alu_slot_cnt_; i++) {
+    std::cout << "\toutput_[" << i << "] = " << output_.GetCur()[i].ToString() << "\n";
+  }
+  std::cout << "\n";
+}
+
+CommonDataBus ALU::GetCommonDataBus(const Memory &memory) const {
+  return CommonDataBus(memory.output_.GetCur(), output_.GetCur(), alu_slot_cnt_);
+}
+
+bool ALU::HasWork(const ReservationStation &rs) const {
+  if (in_flight_cnt_ != 0) {
+    return true;
+  }
+  for (int i = 0; i < alu_slot_cnt_; i++) {
+    if (output_.GetCur()[i].done_) {
+      return true;
+    }
+  }
+  for (int i = 0; i < port_cnt_; i++) {
+    if (rs.to_alu_.GetCur()[i].execute_) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void ALU::Update() {
@@ -18,17 +75,29 @@ void ALU::Update() {
   wc_.Update();
 }
 
+void ALU::Serialize(std::ostream &out) const {
+  output_.Serialize(out);
+  wc_.Serialize(out);
+  WriteBinary(out, pipeline_);
+  WriteBinary(out, head_);
+  WriteBinary(out, in_flight_cnt_);
+}
+
+void ALU::Deserialize(std::istream &in) {
+  output_.Deserialize(in);
+  wc_.Deserialize(in);
+  ReadBinary(in, pipeline_);
+  ReadBinary(in, head_);
+  ReadBinary(in, in_flight_cnt_);
+}
+
 #ifdef _DEBUG
 void ALU::Execute(const ReorderBuffer &rb, const ReservationStation &rs) {
   if (wc_.IsBusy()) {
     return;
   }
   auto write_func = [this, from_rs = rs.to_alu_.GetCur(), flush = rb.flush_.GetCur().flush_]() {
-    if (flush) {
-      Flush();
-      return;
-    }
-    WriteOutput(from_rs);
+    FinishOperation(from_rs, flush);
   };
   wc_.Set(write_func, 1);
 }
@@ -39,11 +108,7 @@ void ALU::Execute(const ReorderBuffer &rb, const ReservationStation &rs) {
   }
   auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                        RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-    if (rb.flush_.GetCur().flush_) {
-      alu.Flush();
-      return;
-    }
-    alu.WriteOutput(rs.to_alu_.GetCur());
+    alu.FinishOperation(rs.to_alu_.GetCur(), rb.flush_.GetCur().flush_);
   };
   wc_.Set(write_func, 1);
 }
@@ -70,60 +135,108 @@ void ALU::ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreB
 #endif
 
 void ALU::Flush() {
-  output_.New().done_ = false;
+  for (int i = 0; i < alu_slot_cnt_; i++) {
+    if (output_.GetNew()[i].done_) {
+      output_.New()[i].done_ = false;
+    }
+  }
+  for (auto &ops : pipeline_) {
+    for (RSToALU &op : ops) {
+      op.execute_ = false;
+    }
+  }
+  in_flight_cnt_ = 0;
 }
 
-void ALU::WriteOutput(const RSToALU &from_rs) {
-  output_.New().done_ = false;
-  if (!from_rs.execute_) {
+// Every operation in flight is younger than the instruction that causes a flush, so a flush empties the pipeline. An
+// operation with a latency of n finishes n - 1 calls after the one that starts it, and the ones finishing now take the
+// slots of the common data bus in order.
+void ALU::FinishOperation(const std::array<RSToALU, kMaxIssuePortCnt> &from_rs, bool flush) {
+  if (flush) {
+    Flush();
     return;
   }
-  output_.New().id_ = from_rs.id_;
+  std::array<RSToALU, kMaxCDBWidth - 1> &finishing = pipeline_[head_];
+  int slot = 0;
+  for (int i = 0; i < alu_slot_cnt_; i++) {
+    if (finishing[i].execute_) {
+      WriteOutput(slot++, finishing[i]);
+      finishing[i].execute_ = false;
+      in_flight_cnt_--;
+    }
+  }
+  head_ = (head_ + 1 == kMaxALULatency - 1 ? 0 : head_ + 1);
+  for (int i = 0; i < port_cnt_; i++) {
+    if (!from_rs[i].execute_) {
+      continue;
+    }
+    if (from_rs[i].latency_ == 1) {
+      WriteOutput(slot++, from_rs[i]);
+      continue;
+    }
+    std::array<RSToALU, kMaxCDBWidth - 1> &later = pipeline_[(head_ + from_rs[i].latency_ - 2) % (kMaxALULatency - 1)];
+    int k = 0;
+    while (later[k].execute_) {
+      k++;
+    }
+    later[k] = from_rs[i];
+    in_flight_cnt_++;
+  }
+  for (; slot < alu_slot_cnt_; slot++) {
+    if (output_.GetNew()[slot].done_) {
+      output_.New()[slot].done_ = false;
+    }
+  }
+}
+
+void ALU::WriteOutput(int slot, const RSToALU &from_rs) {
+  ALUOutput &output = output_.New()[slot];
+  output.id_ = from_rs.id_;
   switch (from_rs.alu_op_type_) {
     case kAdd:
-      output_.New().val_ = from_rs.in1_ + from_rs.in2_;
+      output.val_ = from_rs.in1_ + from_rs.in2_;
       break;
     case kSub:
-      output_.New().val_ = from_rs.in1_ - from_rs.in2_;
+      output.val_ = from_rs.in1_ - from_rs.in2_;
       break;
     case kAnd:
-      output_.New().val_ = from_rs.in1_ & from_rs.in2_;
+      output.val_ = from_rs.in1_ & from_rs.in2_;
       break;
     case kOr:
-      output_.New().val_ = from_rs.in1_ | from_rs.in2_;
+      output.val_ = from_rs.in1_ | from_rs.in2_;
       break;
     case kXor:
-      output_.New().val_ = from_rs.in1_ ^ from_rs.in2_;
+      output.val_ = from_rs.in1_ ^ from_rs.in2_;
       break;
     case kShiftLeftLogical:
-      output_.New().val_ = from_rs.in1_ << from_rs.in2_;
+      output.val_ = from_rs.in1_ << from_rs.in2_;
       break;
     case kShiftRightLogical:
-      output_.New().val_ = from_rs.in1_ >> from_rs.in2_;
+      output.val_ = from_rs.in1_ >> from_rs.in2_;
       break;
     case kShiftRightArithmetic:
-      output_.New().val_ = static_cast<int32_t>(from_rs.in1_) >> static_cast<int32_t>(from_rs.in2_);
+      output.val_ = static_cast<int32_t>(from_rs.in1_) >> static_cast<int32_t>(from_rs.in2_);
       break;
     case kEqual:
-      output_.New().val_ = (from_rs.in1_ == from_rs.in2_);
+      output.val_ = (from_rs.in1_ == from_rs.in2_);
       break;
     case kNotEqual:
-      output_.New().val_ = (from_rs.in1_ != from_rs.in2_);
+      output.val_ = (from_rs.in1_ != from_rs.in2_);
       break;
     case kLessThan:
-      output_.New().val_ = (static_cast<int32_t>(from_rs.in1_) < static_cast<int32_t>(from_rs.in2_));
+      output.val_ = (static_cast<int32_t>(from_rs.in1_) < static_cast<int32_t>(from_rs.in2_));
       break;
     case kLessThanUnsigned:
-      output_.New().val_ = (from_rs.in1_ < from_rs.in2_);
+      output.val_ = (from_rs.in1_ < from_rs.in2_);
       break;
     case kGreaterOrEqual:
-      output_.New().val_ = static_cast<int32_t>(from_rs.in1_) >= static_cast<int32_t>(from_rs.in2_);
+      output.val_ = static_cast<int32_t>(from_rs.in1_) >= static_cast<int32_t>(from_rs.in2_);
       break;
     case kGreaterOrEqualUnsigned:
-      output_.New().val_ = (from_rs.in1_ >= from_rs.in2_);
+      output.val_ = (from_rs.in1_ >= from_rs.in2_);
       break;
   }
-  output_.New().done_ = true;
+  output.done_ = true;
 }
 
 }
\ No newline at end of file
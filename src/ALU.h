@@ -1,6 +1,8 @@
 #ifndef RISC_V_SIMULATOR_ALU_H
 #define RISC_V_SIMULATOR_ALU_H
 
+#include <array>
+
 #include "Clock.h"
 #include "config.h"
 #include "WriteController.h"
@@ -8,6 +10,7 @@
 namespace bubble {
 
 #ifdef _DEBUG
+class Memory;
 class ReorderBuffer;
 class ReservationStation;
 #else
@@ -21,11 +24,43 @@ class ReorderBuffer;
 class ReservationStation;
 #endif
 
+/*
+ * CommonDataBus is the common data bus of a cycle as seen by the units that wait for results: the result of the memory
+ * followed by the results of the ALU. ForEachResult(func) calls func(id, val) for each result broadcast, and Find(id,
+ * val) tells whether the result of RoB entry id is among them. It only reads the current values of registers, so it
+ * stays valid until the next Update().
+ */
+class CommonDataBus {
+ public:
+  CommonDataBus(const MemoryOutput &from_mem, const std::array<ALUOutput, kMaxCDBWidth - 1> &from_alu,
+                int alu_slot_cnt);
+
+  bool HasResult() const;
+  bool Find(int id, uint32_t &val) const;
+  template<class Func>
+  void ForEachResult(Func func) const;
+
+ private:
+  const MemoryOutput *from_mem_;
+  const std::array<ALUOutput, kMaxCDBWidth - 1> *from_alu_;
+  int alu_slot_cnt_;
+};
+
+/*
+ * The ALU stands for the functional units behind the issue ports of the reservation station. An operation with a
+ * latency_ of n is broadcast n - 1 cycles later than with a single-cycle unit. The reservation station issues so that
+ * no unpipelined unit gets a new operation before it is done and at most alu_slot_cnt_ results, the slots of the
+ * common data bus left by the memory, are broadcast a cycle.
+ */
 class ALU {
  public:
-  ALU(const Clock &clock);
+  ALU(const Clock &clock, const Config &config);
 
   void Debug() const;
+  CommonDataBus GetCommonDataBus(const Memory &memory) const;
+  bool HasWork(const ReservationStation &rs) const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
   void Update();
   void Execute(const ReorderBuffer &rb, const ReservationStation &rs);
 #ifdef _DEBUG
@@ -38,15 +73,34 @@ class ALU {
                   RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs);
 #endif
 
-  Register<ALUOutput> output_;
+  // Only output_[0, alu_slot_cnt_) is used.
+  Register<std::array<ALUOutput, kMaxCDBWidth - 1>> output_;
 
  private:
   void Flush();
-  void WriteOutput(const RSToALU &from_rs);
+  void FinishOperation(const std::array<RSToALU, kMaxIssuePortCnt> &from_rs, bool flush);
+  void WriteOutput(int slot, const RSToALU &from_rs);
 
   WriteController wc_;
+  // The operations in the later stages by the cycle they finish in, a ring buffer starting at head_ with the next
+  // ones, up to alu_slot_cnt_ a cycle.
+  std::array<std::array<RSToALU, kMaxCDBWidth - 1>, kMaxALULatency - 1> pipeline_;
+  int head_, in_flight_cnt_;
+  int port_cnt_, alu_slot_cnt_;
 };
 
+template<class Func>
+void CommonDataBus::ForEachResult(Func func) const {
+  if (from_mem_->done_) {
+    func(from_mem_->id_, from_mem_->val_);
+  }
+  for (int i = 0; i < alu_slot_cnt_; i++) {
+    if ((*from_alu_)[i].done_) {
+      func((*from_alu_)[i].id_, (*from_alu_)[i].val_);
+    }
+  }
+}
+
 
 }
 
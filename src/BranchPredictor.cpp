@@ -1,41 +1,160 @@
+#include "utils/Serialization.h"
+
 #include "BranchPredictor.h"
 
 namespace bubble {
 
-BranchPredictor::BranchPredictor() : total_(), correct_() {
-  for (auto &item : predictor_) {
-    item = 0b01;
-  }
-}
+BranchPredictor::BranchPredictor(const Config &config) :
+    direction_(DirectionPredictor::Create(config)),
+    history_mask_(config.bp_history_ == 64 ? ~uint64_t(0) : (uint64_t(1) << config.bp_history_) - 1),
+    speculative_history_(0), committed_history_(0), total_(0), correct_(0), btb_size_(config.btb_size_),
+    indirect_size_(config.indirect_size_), btb_(), indirect_(), speculative_path_(0), committed_path_(0),
+    target_total_(0), target_correct_(0), return_total_(0), return_correct_(0) {}
 
-bool BranchPredictor::Predict(uint32_t pc) const {
-  return predictor_[GetHash(pc)] & 0b10;
+// Fetch predicts the branch at pc, and the branches fetched after it are predicted as if it went that way.
+bool BranchPredictor::Predict(uint32_t pc) {
+  bool jump = direction_->Predict(pc, speculative_history_);
+  speculative_history_ = ((speculative_history_ << 1) | jump) & history_mask_;
+  return jump;
 }
 
 void BranchPredictor::Update(uint32_t pc, bool jump, bool correct) {
-  total_[GetHash(pc)]++;
-  correct_[GetHash(pc)] += (correct ? 1 : 0);
-  uint8_t &pred = predictor_[GetHash(pc)];
-  if (jump && pred != 0b11) {
-    pred++;
+  total_++;
+  correct_ += (correct ? 1 : 0);
+  direction_->Update(pc, committed_history_, jump);
+  committed_history_ = ((committed_history_ << 1) | jump) & history_mask_;
+}
+
+void BranchPredictor::Flush() {
+  speculative_history_ = committed_history_;
+  speculative_path_ = committed_path_;
+}
+
+uint64_t BranchPredictor::GetHistory() const {
+  return speculative_history_;
+}
+
+uint32_t BranchPredictor::GetPathHistory() const {
+  return speculative_path_;
+}
+
+// Fetch goes back to a point where the speculative histories were history and path_history, dropping the predictions
+// made since.
+void BranchPredictor::RestoreHistory(uint64_t history, uint32_t path_history) {
+  speculative_history_ = history;
+  speculative_path_ = path_history;
+}
+
+double BranchPredictor::GetAccuracy() const {
+  if (total_ == 0) {
+    return 1;
+  }
+  return static_cast<double>(correct_) / total_;
+}
+
+// Whether the JALR at pc has a predicted target, and the target if so. The JALRs fetched after it are predicted as if
+// it went there, and a JALR without a target is flushed at commit anyway.
+bool BranchPredictor::PredictTarget(uint32_t pc, uint32_t &target) {
+  if (btb_size_ == 0) {
+    return false;
+  }
+  bool found = false;
+  if (indirect_size_ != 0) {
+    const TargetEntry &entry = indirect_[GetIndirectHash(pc, speculative_path_)];
+    if (entry.valid_ && entry.pc_ == pc) {
+      target = entry.target_;
+      found = true;
+    }
   }
-  if (!jump && pred != 0b00) {
-    pred--;
+  if (!found) {
+    const TargetEntry &entry = btb_[GetBTBHash(pc)];
+    target = entry.target_;
+    found = entry.valid_ && entry.pc_ == pc;
   }
+  if (indirect_size_ != 0) {
+    speculative_path_ = (speculative_path_ << 2) ^ ((found ? target : 0) >> 2);
+  }
+  return found;
 }
 
-double BranchPredictor::GetAccuracy() const {
-  unsigned long long total = 0, correct = 0;
-  for (auto item : total_) {
-    total += item;
+// A JALR at pc committed with target. The BTB keeps the last target of every JALR, while the indirect target predictor
+// only takes the JALRs the BTB got wrong, which are the ones with more than one target.
+void BranchPredictor::UpdateTarget(uint32_t pc, uint32_t target, bool correct) {
+  if (btb_size_ == 0) {
+    return;
   }
-  for (auto item : correct_) {
-    correct += item;
+  target_total_++;
+  target_correct_ += (correct ? 1 : 0);
+  TargetEntry &btb_entry = btb_[GetBTBHash(pc)];
+  if (indirect_size_ != 0) {
+    TargetEntry &entry = indirect_[GetIndirectHash(pc, committed_path_)];
+    if ((entry.valid_ && entry.pc_ == pc) || (btb_entry.valid_ && btb_entry.pc_ == pc && btb_entry.target_ != target)) {
+      entry = {true, pc, target};
+    }
+    committed_path_ = (committed_path_ << 2) ^ (target >> 2);
   }
-  if (total == 0) {
+  btb_entry = {true, pc, target};
+}
+
+double BranchPredictor::GetTargetAccuracy() const {
+  if (target_total_ == 0) {
+    return 1;
+  }
+  return static_cast<double>(target_correct_) / target_total_;
+}
+
+// A return predicted by the return address stack committed.
+void BranchPredictor::UpdateReturn(bool correct) {
+  return_total_++;
+  return_correct_ += (correct ? 1 : 0);
+}
+
+double BranchPredictor::GetReturnAccuracy() const {
+  if (return_total_ == 0) {
     return 1;
   }
-  return static_cast<double>(correct) / total;
+  return static_cast<double>(return_correct_) / return_total_;
+}
+
+// Only the btb_size_ and indirect_size_ entries in use are written.
+void BranchPredictor::Serialize(std::ostream &out) const {
+  direction_->Serialize(out);
+  WriteBinary(out, speculative_history_);
+  WriteBinary(out, committed_history_);
+  WriteBinary(out, total_);
+  WriteBinary(out, correct_);
+  for (int i = 0; i < btb_size_; i++) {
+    WriteBinary(out, btb_[i]);
+  }
+  for (int i = 0; i < indirect_size_; i++) {
+    WriteBinary(out, indirect_[i]);
+  }
+  WriteBinary(out, speculative_path_);
+  WriteBinary(out, committed_path_);
+  WriteBinary(out, target_total_);
+  WriteBinary(out, target_correct_);
+  WriteBinary(out, return_total_);
+  WriteBinary(out, return_correct_);
+}
+
+void BranchPredictor::Deserialize(std::istream &in) {
+  direction_->Deserialize(in);
+  ReadBinary(in, speculative_history_);
+  ReadBinary(in, committed_history_);
+  ReadBinary(in, total_);
+  ReadBinary(in, correct_);
+  for (int i = 0; i < btb_size_; i++) {
+    ReadBinary(in, btb_[i]);
+  }
+  for (int i = 0; i < indirect_size_; i++) {
+    ReadBinary(in, indirect_[i]);
+  }
+  ReadBinary(in, speculative_path_);
+  ReadBinary(in, committed_path_);
+  ReadBinary(in, target_total_);
+  ReadBinary(in, target_correct_);
+  ReadBinary(in, return_total_);
+  ReadBinary(in, return_correct_);
 }
 
 }
\ No newline at end of file
@@ -2,26 +2,67 @@
 #define RISC_V_SIMULATOR_BRANCHPREDICTOR_H
 
 #include <cstdint>
+#include <iostream>
+#include <memory>
+
+#include "config.h"
+#include "DirectionPredictor.h"
 
 namespace bubble {
 
+/*
+ * The direction of a conditional branch comes from the DirectionPredictor chosen by config.bp_type_, given the global
+ * history of the last config.bp_history_ branches. Predict shifts its prediction into a speculative history at fetch
+ * and Update shifts the outcome into a committed one at commit. Every flush happens at the commit of the instruction
+ * that causes it, so Flush repairs the speculative history by copying the committed one, and the history a branch is
+ * predicted with is always the one it is updated with.
+ * The target of a JALR comes from the indirect target predictor, indexed by the pc and the targets of the last JALRs
+ * so that a jump with several targets gets one entry for each path leading to it, or else from the branch target
+ * buffer, indexed by the pc alone. Both are tagged with the pc and have config.btb_size_ and config.indirect_size_
+ * entries. The path history is kept like the branch history: PredictTarget shifts the predicted target into a
+ * speculative one and UpdateTarget the real target into a committed one, and Flush and RestoreHistory repair both.
+ */
 class BranchPredictor {
  public:
-  BranchPredictor();
+  explicit BranchPredictor(const Config &config);
 
-  bool Predict(uint32_t pc) const;
+  bool Predict(uint32_t pc);
   void Update(uint32_t pc, bool jump, bool correct);
+  void Flush();
+  uint64_t GetHistory() const;
+  uint32_t GetPathHistory() const;
+  void RestoreHistory(uint64_t history, uint32_t path_history);
   double GetAccuracy() const;
+  bool PredictTarget(uint32_t pc, uint32_t &target);
+  void UpdateTarget(uint32_t pc, uint32_t target, bool correct);
+  double GetTargetAccuracy() const;
+  void UpdateReturn(bool correct);
+  double GetReturnAccuracy() const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
 
  private:
-  static constexpr int kMod = 128;
+  struct TargetEntry {
+    bool valid_ = false;
+    uint32_t pc_ = 0, target_ = 0;
+  };
+
+  int GetBTBHash(uint32_t pc) const {
+    return (pc >> 2) & (btb_size_ - 1);
+  }
 
-  static constexpr int GetHash(uint32_t pc) {
-    return pc % kMod;
+  int GetIndirectHash(uint32_t pc, uint32_t path_history) const {
+    return ((pc >> 2) ^ path_history) & (indirect_size_ - 1);
   }
 
-  uint8_t predictor_[kMod];
-  unsigned long long total_[kMod], correct_[kMod];
+  std::unique_ptr<DirectionPredictor> direction_;
+  uint64_t history_mask_, speculative_history_, committed_history_;
+  unsigned long long total_, correct_;
+  int btb_size_, indirect_size_;
+  TargetEntry btb_[kMaxBTBSize], indirect_[kMaxBTBSize];
+  // The low bits of the last JALR targets, two bits each.
+  uint32_t speculative_path_, committed_path_;
+  unsigned long long target_total_, target_correct_, return_total_, return_correct_;
 };
 
 }
@@ -1,6 +1,8 @@
+#include <array>
 #include <cassert>
 #include <fstream>
 #include <algorithm>
+#include <iostream>
 
 #include "utils/NumberOperation.h"
 
@@ -8,13 +10,19 @@
 
 namespace bubble {
 
-CPU::CPU() :
-    clock_(), bp_(), alu_(clock_), decoder_(clock_), iu_(clock_, bp_), lsb_(clock_), memory_(clock_), rf_(clock_), rb_(
-    clock_, bp_), rs_(clock_) {}
+CPU::CPU(const Config &config) :
+    config_(config), clock_(), bp_(config), ssp_(config), ras_(config), alu_(clock_, config), decoder_(clock_),
+    iu_(clock_, config, bp_, ras_), lsb_(clock_, config, ssp_), memory_(clock_, config), rf_(clock_),
+    rb_(clock_, config, bp_, ras_), rs_(clock_, config),
+    active_{true, true, true, true, true, true, true, true}, order_{0, 1, 2, 3, 4, 5, 6, 7}, order_fuzz_(false),
+    order_rng_() {}
 
-CPU::CPU(const std::string &pc_file_name, const std::string pc_with_cycle_file_name) :
-    clock_(), bp_(), alu_(clock_), decoder_(clock_), iu_(clock_, bp_), lsb_(clock_), memory_(clock_), rf_(clock_), rb_(
-    clock_, bp_, pc_file_name, pc_with_cycle_file_name), rs_(clock_) {}
+CPU::CPU(const std::string &pc_file_name, const std::string pc_with_cycle_file_name, const Config &config) :
+    config_(config), clock_(), bp_(config), ssp_(config), ras_(config), alu_(clock_, config), decoder_(clock_),
+    iu_(clock_, config, bp_, ras_), lsb_(clock_, config, ssp_), memory_(clock_, config), rf_(clock_),
+    rb_(clock_, config, bp_, ras_, pc_file_name, pc_with_cycle_file_name), rs_(clock_, config),
+    active_{true, true, true, true, true, true, true, true}, order_{0, 1, 2, 3, 4, 5, 6, 7}, order_fuzz_(false),
+    order_rng_() {}
 
 void CPU::Debug() {
   if (clock_.GetCycleCount() >= 100000) {
@@ -41,10 +49,281 @@ void CPU::LoadMemory() {
   memory_.Init(std::cin);
 }
 
+void CPU::LoadMemory(const MemoryImage &image) {
+  memory_.Init(image);
+}
+
+void CPU::EnableOrderFuzz(uint32_t seed) {
+  order_fuzz_ = true;
+  order_rng_.seed(seed);
+  std::clog << "order-fuzz seed: " << seed << "\n";
+}
+
+/*
+ * Execute at most inst_cnt instructions functionally, without modelling the pipeline, stopping early before the
+ * instruction at stop_pc or before HALT. The registers, the memory and the pc are left where the pipeline would have
+ * left them after committing the same instructions, so the timing model can go on from there. It must be called
+ * before the clock starts running. Returns the number of instructions executed.
+ */
+uint64_t CPU::FastForward(uint64_t inst_cnt, uint32_t stop_pc) {
+  if (clock_.IsRunning()) {
+    return 0;
+  }
+  std::array<uint32_t, kXLen> reg = rf_.value_.GetCur();
+  uint32_t pc = iu_.pc_.GetCur();
+  uint64_t executed = 0;
+  for (; executed < inst_cnt && pc != stop_pc; executed++) {
+    uint32_t inst = memory_.FetchWord(pc);
+    DecoderOutput out;
+    if (!Decoder::GetOperands(out, inst) || !Decoder::GetInstType(out, inst)) {
+      // The decoder drops instructions it does not recognize, so they act as no-ops.
+      pc += 4;
+      continue;
+    }
+    if (out.inst_type_ == kHALT) {
+      break;
+    }
+    uint32_t rs1 = reg[out.rs1_], rs2 = reg[out.rs2_], imm = out.imm_;
+    uint32_t next_pc = pc + 4;
+    uint32_t val = 0;
+    bool write_rd = true;
+    switch (out.inst_type_) {
+      case kLUI:
+        val = imm;
+        break;
+      case kAUIPC:
+        val = pc + imm;
+        break;
+      case kJAL:
+        val = pc + 4;
+        next_pc = pc + imm;
+        break;
+      case kJALR:
+        val = pc + 4;
+        next_pc = rs1 + imm;
+        break;
+      case kBEQ:
+      case kBNE:
+      case kBLT:
+      case kBGE:
+      case kBLTU:
+      case kBGEU: {
+        bool taken;
+        switch (out.inst_type_) {
+          case kBEQ:
+            taken = rs1 == rs2;
+            break;
+          case kBNE:
+            taken = rs1 != rs2;
+            break;
+          case kBLT:
+            taken = static_cast<int32_t>(rs1) < static_cast<int32_t>(rs2);
+            break;
+          case kBGE:
+            taken = static_cast<int32_t>(rs1) >= static_cast<int32_t>(rs2);
+            break;
+          case kBLTU:
+            taken = rs1 < rs2;
+            break;
+          default:
+            taken = rs1 >= rs2;
+            break;
+        }
+        if (taken) {
+          next_pc = pc + imm;
+        }
+        write_rd = false;
+        break;
+      }
+      case kLB:
+        val = SignExtend(memory_.LoadByte(rs1 + imm), 7);
+        break;
+      case kLH:
+        val = SignExtend(memory_.LoadHalf(rs1 + imm), 15);
+        break;
+      case kLW:
+        val = memory_.LoadWord(rs1 + imm);
+        break;
+      case kLBU:
+        val = memory_.LoadByte(rs1 + imm);
+        break;
+      case kLHU:
+        val = memory_.LoadHalf(rs1 + imm);
+        break;
+      case kSB:
+        memory_.StoreByte(rs1 + imm, GetSub(rs2, 7, 0));
+        write_rd = false;
+        break;
+      case kSH:
+        memory_.StoreHalf(rs1 + imm, GetSub(rs2, 15, 0));
+        write_rd = false;
+        break;
+      case kSW:
+        memory_.StoreWord(rs1 + imm, rs2);
+        write_rd = false;
+        break;
+      case kADDI:
+        val = rs1 + imm;
+        break;
+      case kSLTI:
+        val = static_cast<int32_t>(rs1) < static_cast<int32_t>(imm);
+        break;
+      case kSLTIU:
+        val = rs1 < imm;
+        break;
+      case kXORI:
+        val = rs1 ^ imm;
+        break;
+      case kORI:
+        val = rs1 | imm;
+        break;
+      case kANDI:
+        val = rs1 & imm;
+        break;
+      case kSLLI:
+        val = rs1 << imm;
+        break;
+      case kSRLI:
+        val = rs1 >> imm;
+        break;
+      case kSRAI:
+        val = static_cast<int32_t>(rs1) >> static_cast<int32_t>(imm);
+        break;
+      case kADD:
+        val = rs1 + rs2;
+        break;
+      case kSUB:
+        val = rs1 - rs2;
+        break;
+      case kSLL:
+        val = rs1 << rs2;
+        break;
+      case kSLT:
+        val = static_cast<int32_t>(rs1) < static_cast<int32_t>(rs2);
+        break;
+      case kSLTU:
+        val = rs1 < rs2;
+        break;
+      case kXOR:
+        val = rs1 ^ rs2;
+        break;
+      case kSRL:
+        val = rs1 >> rs2;
+        break;
+      case kSRA:
+        val = static_cast<int32_t>(rs1) >> static_cast<int32_t>(rs2);
+        break;
+      case kOR:
+        val = rs1 | rs2;
+        break;
+      case kAND:
+        val = rs1 & rs2;
+        break;
+      default:
+        write_rd = false;
+        break;
+    }
+    if (write_rd && out.rd_ != 0) {
+      reg[out.rd_] = val;
+    }
+    pc = next_pc;
+  }
+  for (int i = 1; i < kXLen; i++) {
+    if (reg[i] != rf_.value_.GetCur()[i]) {
+      rf_.value_.New()[i] = reg[i];
+    }
+  }
+  rf_.value_.Update();
+  iu_.pc_ = Register<uint32_t>(pc);
+  iu_.expected_pc_ = Register<uint32_t>(pc);
+  return executed;
+}
+
+/*
+ * A checkpoint holds the state of every unit between two cycles, i.e. after Tick() and before the next Update(), and
+ * starts with a header that rejects checkpoints of a CPU with another Config. The pc trace files of the debug
+ * build and the order-fuzz state are not part of it.
+ */
+bool CPU::SaveCheckpoint(std::ostream &out) const {
+  WriteBinary(out, kCheckpointMagic);
+  WriteBinary(out, kCheckpointVersion);
+  std::string config = config_.ToString();
+  WriteBinary(out, static_cast<uint32_t>(config.size()));
+  out.write(config.data(), config.size());
+  clock_.Serialize(out);
+  bp_.Serialize(out);
+  ssp_.Serialize(out);
+  ras_.Serialize(out);
+  alu_.Serialize(out);
+  decoder_.Serialize(out);
+  iu_.Serialize(out);
+  lsb_.Serialize(out);
+  memory_.Serialize(out);
+  rf_.Serialize(out);
+  rb_.Serialize(out);
+  rs_.Serialize(out);
+  return static_cast<bool>(out);
+}
+
+bool CPU::SaveCheckpoint(const std::string &path) const {
+  std::ofstream out(path, std::ios::binary);
+  if (!SaveCheckpoint(out)) {
+    return false;
+  }
+  out.close();
+  return static_cast<bool>(out);
+}
+
+bool CPU::LoadCheckpoint(std::istream &in) {
+  uint32_t magic = 0, version = 0;
+  uint32_t config_size = 0;
+  ReadBinary(in, magic);
+  ReadBinary(in, version);
+  ReadBinary(in, config_size);
+  if (!in || magic != kCheckpointMagic || version != kCheckpointVersion || config_size != config_.ToString().size()) {
+    return false;
+  }
+  std::string config(config_size, '\0');
+  in.read(&config[0], config_size);
+  if (!in || config != config_.ToString()) {
+    return false;
+  }
+  clock_.Deserialize(in);
+  bp_.Deserialize(in);
+  ssp_.Deserialize(in);
+  ras_.Deserialize(in);
+  alu_.Deserialize(in);
+  decoder_.Deserialize(in);
+  iu_.Deserialize(in);
+  lsb_.Deserialize(in);
+  memory_.Deserialize(in);
+  rf_.Deserialize(in);
+  rb_.Deserialize(in);
+  rs_.Deserialize(in);
+  // Every register may differ from the state Step() last saw, so all units are updated and checked in the next step.
+  std::fill(active_, active_ + 8, true);
+  return static_cast<bool>(in);
+}
+
+bool CPU::LoadCheckpoint(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return LoadCheckpoint(in);
+}
+
 void CPU::Update() {
-  static int order[8] = {0, 1, 2, 3, 4, 5, 6, 7};
-  std::random_shuffle(order, order + 8);
-  for (auto i : order) {
+  if (!order_fuzz_) {
+    alu_.Update();
+    decoder_.Update();
+    iu_.Update();
+    lsb_.Update();
+    memory_.Update();
+    rf_.Update();
+    rb_.Update();
+    rs_.Update();
+    return;
+  }
+  std::shuffle(order_, order_ + 8, order_rng_);
+  for (auto i : order_) {
     switch (i) {
       case 0:
         alu_.Update();
@@ -75,9 +354,19 @@ void CPU::Update() {
 }
 
 void CPU::Execute() {
-  static int order[8] = {0, 1, 2, 3, 4, 5, 6, 7};
-  std::random_shuffle(order, order + 8);
-  for (auto i : order) {
+  if (!order_fuzz_) {
+    alu_.Execute(rb_, rs_);
+    decoder_.Execute(iu_, lsb_, rb_, rs_);
+    iu_.Execute(decoder_, lsb_, memory_, rb_, rs_);
+    lsb_.Execute(alu_, decoder_, memory_, rb_, rf_, rs_);
+    memory_.Execute(iu_, lsb_, rb_);
+    rf_.Execute(decoder_, lsb_, rb_, rs_);
+    rb_.Execute(alu_, decoder_, lsb_, memory_, rs_);
+    rs_.Execute(alu_, decoder_, lsb_, memory_, rb_, rf_);
+    return;
+  }
+  std::shuffle(order_, order_ + 8, order_rng_);
+  for (auto i : order_) {
     switch (i) {
       case 0:
         alu_.Execute(rb_, rs_);
@@ -108,10 +397,20 @@ void CPU::Execute() {
 }
 
 void CPU::Write() {
-  static int order[8] = {0, 1, 2, 3, 4, 5, 6, 7};
-  std::random_shuffle(order, order + 8);
 #ifdef _DEBUG
-  for (auto i : order) {
+  if (!order_fuzz_) {
+    alu_.Write();
+    decoder_.Write();
+    iu_.Write();
+    lsb_.Write();
+    memory_.Write();
+    rf_.Write();
+    rb_.Write();
+    rs_.Write();
+    return;
+  }
+  std::shuffle(order_, order_ + 8, order_rng_);
+  for (auto i : order_) {
     switch (i) {
       case 0:
         alu_.Write();
@@ -140,7 +439,19 @@ void CPU::Write() {
     }
   }
 #else
-  for (auto i : order) {
+  if (!order_fuzz_) {
+    alu_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+    decoder_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+    iu_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+    lsb_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+    memory_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+    rf_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+    rb_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+    rs_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+    return;
+  }
+  std::shuffle(order_, order_ + 8, order_rng_);
+  for (auto i : order_) {
     switch (i) {
       case 0:
         alu_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
@@ -171,6 +482,131 @@ void CPU::Write() {
 #endif
 }
 
+/*
+ * Event-driven alternative to calling Update(), Execute() and Write() every cycle. A unit without work would only
+ * rewrite its registers with the values they already hold, so it is not called at all, and a unit that was not called
+ * has New() == GetCur() and needs no Update() in the next step either. When no unit has work, the clock jumps straight
+ * to the next cycle in which the memory finishes a data access. The cycle count is the same as in the lockstep loop.
+ */
+void CPU::Step() {
+  if (active_[0]) {
+    alu_.Update();
+  }
+  if (active_[1]) {
+    decoder_.Update();
+  }
+  if (active_[2]) {
+    iu_.Update();
+  }
+  if (active_[3]) {
+    lsb_.Update();
+  }
+  if (active_[4]) {
+    memory_.Update();
+  }
+  if (active_[5]) {
+    rf_.Update();
+  }
+  if (active_[6]) {
+    rb_.Update();
+  }
+  if (active_[7]) {
+    rs_.Update();
+  }
+  active_[0] = alu_.HasWork(rs_);
+  active_[1] = decoder_.HasWork(iu_, lsb_, rb_, rs_);
+  active_[2] = iu_.HasWork(decoder_, lsb_, memory_, rb_, rs_);
+  active_[3] = lsb_.HasWork(alu_, decoder_, memory_, rb_, rs_);
+  active_[4] = memory_.HasWork(iu_, lsb_, rb_);
+  active_[5] = rf_.HasWork(decoder_, lsb_, rb_, rs_);
+  active_[6] = rb_.HasWork(alu_, decoder_, lsb_, memory_, rs_);
+  active_[7] = rs_.HasWork(alu_, decoder_, lsb_, memory_, rb_);
+  if (!(active_[0] || active_[1] || active_[2] || active_[3] || active_[4] || active_[5] || active_[6] ||
+        active_[7])) {
+    uint32_t next_event_cycle = memory_.GetNextEventCycle();
+    if (next_event_cycle != UINT32_MAX) {
+      clock_.AdvanceTo(next_event_cycle);
+      active_[4] = memory_.HasWork(iu_, lsb_, rb_);
+    }
+  }
+  if (active_[0]) {
+    alu_.Execute(rb_, rs_);
+  }
+  if (active_[1]) {
+    decoder_.Execute(iu_, lsb_, rb_, rs_);
+  }
+  if (active_[2]) {
+    iu_.Execute(decoder_, lsb_, memory_, rb_, rs_);
+  }
+  if (active_[3]) {
+    lsb_.Execute(alu_, decoder_, memory_, rb_, rf_, rs_);
+  }
+  if (active_[4]) {
+    memory_.Execute(iu_, lsb_, rb_);
+  }
+  if (active_[5]) {
+    rf_.Execute(decoder_, lsb_, rb_, rs_);
+  }
+  if (active_[6]) {
+    rb_.Execute(alu_, decoder_, lsb_, memory_, rs_);
+  }
+  if (active_[7]) {
+    rs_.Execute(alu_, decoder_, lsb_, memory_, rb_, rf_);
+  }
+#ifdef _DEBUG
+  if (active_[0]) {
+    alu_.Write();
+  }
+  if (active_[1]) {
+    decoder_.Write();
+  }
+  if (active_[2]) {
+    iu_.Write();
+  }
+  if (active_[3]) {
+    lsb_.Write();
+  }
+  if (active_[4]) {
+    memory_.Write();
+  }
+  if (active_[5]) {
+    rf_.Write();
+  }
+  if (active_[6]) {
+    rb_.Write();
+  }
+  if (active_[7]) {
+    rs_.Write();
+  }
+#else
+  if (active_[0]) {
+    alu_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+  }
+  if (active_[1]) {
+    decoder_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+  }
+  if (active_[2]) {
+    iu_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+  }
+  if (active_[3]) {
+    lsb_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+  }
+  if (active_[4]) {
+    memory_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+  }
+  if (active_[5]) {
+    rf_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+  }
+  if (active_[6]) {
+    rb_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+  }
+  if (active_[7]) {
+    rs_.Write(alu_, decoder_, iu_, lsb_, memory_, rf_, rb_, rs_);
+  }
+#endif
+  clock_.Tick();
+}
+
 bool CPU::ShouldHalt() const {
   return rb_.halt_;
 }
@@ -185,7 +621,7 @@ uint32_t CPU::Halt() {
 #endif
   memory_.Update();
   rf_.Update();
-  return GetSub(rf_.value_[10].GetCur(), 7, 0);
+  return GetSub(rf_.value_.GetCur()[10], 7, 0);
 }
 
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define RISC_V_SIMULATOR_CPU_H
 
 #include <cstdint>
+#include <iostream>
+#include <random>
 #include <string>
 
 #include "ALU.h"
@@ -14,25 +16,38 @@
 #include "RegisterFile.h"
 #include "ReorderBuffer.h"
 #include "ReservationStation.h"
+#include "ReturnAddressStack.h"
+#include "StoreSetPredictor.h"
 
 namespace bubble {
 
 class CPU {
  public:
-  CPU();
-  CPU(const std::string &pc_file_name, const std::string pc_with_cycle_file_name);
+  explicit CPU(const Config &config = Config());
+  CPU(const std::string &pc_file_name, const std::string pc_with_cycle_file_name, const Config &config = Config());
 
   void Debug();
   void LoadMemory(const std::string &path);
   void LoadMemory();
+  void LoadMemory(const MemoryImage &image);
+  void EnableOrderFuzz(uint32_t seed);
+  uint64_t FastForward(uint64_t inst_cnt, uint32_t stop_pc = UINT32_MAX);
+  bool SaveCheckpoint(std::ostream &out) const;
+  bool SaveCheckpoint(const std::string &path) const;
+  bool LoadCheckpoint(std::istream &in);
+  bool LoadCheckpoint(const std::string &path);
   void Update();
   void Execute();
   void Write();
+  void Step();
   bool ShouldHalt() const;
   uint32_t Halt();
 
+  const Config config_;
   Clock clock_;
   BranchPredictor bp_;
+  StoreSetPredictor ssp_;
+  ReturnAddressStack ras_;
   ALU alu_;
   Decoder decoder_;
   InstructionUnit iu_;
@@ -41,6 +56,18 @@ class CPU {
   RegisterFile rf_;
   ReorderBuffer rb_;
   ReservationStation rs_;
+
+ private:
+  static constexpr uint32_t kCheckpointMagic = 0x4b434255; // "UBCK"
+  static constexpr uint32_t kCheckpointVersion = 22;
+
+  // active_[i] tells whether unit i (numbered as in Update()) was called in the last Step().
+  bool active_[8];
+  // In order-fuzz mode, Update(), Execute() and Write() call the units in an order shuffled by order_rng_ every cycle,
+  // which checks that the result does not depend on the order. Otherwise the units are called in a fixed order.
+  int order_[8];
+  bool order_fuzz_;
+  std::mt19937 order_rng_;
 };
 
 }
@@ -0,0 +1,113 @@
+#include <algorithm>
+
+#include "utils/Serialization.h"
+
+#include "Cache.h"
+
+namespace bubble {
+
+Cache::Cache(int size, int assoc, int line_size, int latency, ReplacementPolicy replacement,
+             WritePolicy write_policy, Cache *next, int memory_latency) :
+    lines_(), set_cnt_(0), assoc_(assoc), line_bits_(0), latency_(latency), replacement_(replacement),
+    write_policy_(write_policy), next_(next), memory_latency_(memory_latency), access_cnt_(0), miss_cnt_(0),
+    random_state_(2463534242u) {
+  while ((1 << line_bits_) < line_size) {
+    line_bits_++;
+  }
+  if (size > 0) {
+    set_cnt_ = std::max(1, size / (assoc * line_size));
+    lines_.resize(static_cast<std::size_t>(set_cnt_) * assoc_);
+  }
+}
+
+bool Cache::IsEnabled() const {
+  return set_cnt_ != 0;
+}
+
+int Cache::Access(uint32_t addr, bool write) {
+  uint32_t block = addr >> line_bits_;
+  uint32_t tag = block / set_cnt_;
+  Line *set = &lines_[block % set_cnt_ * assoc_];
+  access_cnt_++;
+  for (int i = 0; i < assoc_; i++) {
+    if (set[i].valid_ && set[i].tag_ == tag) {
+      if (replacement_ == kLRU) {
+        set[i].stamp_ = access_cnt_;
+      }
+      if (write && write_policy_ == kWriteThrough) {
+        return latency_ + AccessNext(addr, true);
+      }
+      set[i].dirty_ |= write;
+      return latency_;
+    }
+  }
+  miss_cnt_++;
+  if (write && write_policy_ == kWriteThrough) {
+    return latency_ + AccessNext(addr, true);
+  }
+  Line *victim = std::find_if(set, set + assoc_, [](const Line &line) { return !line.valid_; });
+  if (victim == set + assoc_) {
+    if (replacement_ == kRandom) {
+      random_state_ ^= random_state_ << 13;
+      random_state_ ^= random_state_ >> 17;
+      random_state_ ^= random_state_ << 5;
+      victim = set + random_state_ % assoc_;
+    }
+    else {
+      victim = std::min_element(set, set + assoc_, [](const Line &lhs, const Line &rhs) {
+        return lhs.stamp_ < rhs.stamp_;
+      });
+    }
+    if (victim->dirty_) {
+      AccessNext((victim->tag_ * set_cnt_ + block % set_cnt_) << line_bits_, true);
+    }
+  }
+  int cycle_cnt = latency_ + AccessNext(addr, false);
+  victim->valid_ = true;
+  victim->dirty_ = write;
+  victim->tag_ = tag;
+  victim->stamp_ = access_cnt_;
+  return cycle_cnt;
+}
+
+uint64_t Cache::GetHitCount() const {
+  return access_cnt_ - miss_cnt_;
+}
+
+uint64_t Cache::GetMissCount() const {
+  return miss_cnt_;
+}
+
+double Cache::GetMissRate() const {
+  if (access_cnt_ == 0) {
+    return 0;
+  }
+  return static_cast<double>(miss_cnt_) / access_cnt_;
+}
+
+void Cache::Serialize(std::ostream &out) const {
+  for (const auto &line : lines_) {
+    WriteBinary(out, line);
+  }
+  WriteBinary(out, access_cnt_);
+  WriteBinary(out, miss_cnt_);
+  WriteBinary(out, random_state_);
+}
+
+void Cache::Deserialize(std::istream &in) {
+  for (auto &line : lines_) {
+    ReadBinary(in, line);
+  }
+  ReadBinary(in, access_cnt_);
+  ReadBinary(in, miss_cnt_);
+  ReadBinary(in, random_state_);
+}
+
+int Cache::AccessNext(uint32_t addr, bool write) {
+  if (next_ != nullptr && next_->IsEnabled()) {
+    return next_->Access(addr, write);
+  }
+  return memory_latency_;
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef RISC_V_SIMULATOR_CACHE_H
+#define RISC_V_SIMULATOR_CACHE_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "config.h"
+
+namespace bubble {
+
+/*
+ * The tags of a set-associative cache, used to time the accesses to Memory; the data itself stays in Memory.
+ * Access(addr, write) looks up the line of addr, updates the tags as the access would, and returns the number of cycles
+ * the access takes: the latency of this cache, plus that of the next level (another Cache, or the memory_latency of
+ * the memory behind the last level) on a miss or a write-through store. Dirty lines evicted by a write-back cache are
+ * written to the next level without delaying the access. A cache of size 0 is disabled.
+ */
+class Cache {
+ public:
+  Cache(int size, int assoc, int line_size, int latency, ReplacementPolicy replacement, WritePolicy write_policy,
+        Cache *next, int memory_latency);
+
+  bool IsEnabled() const;
+  int Access(uint32_t addr, bool write);
+  uint64_t GetHitCount() const;
+  uint64_t GetMissCount() const;
+  double GetMissRate() const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
+
+ private:
+  struct Line {
+    bool valid_ = false, dirty_ = false;
+    uint32_t tag_ = 0;
+    // The access that filled the line (FIFO) or last used it (LRU).
+    uint64_t stamp_ = 0;
+  };
+
+  int AccessNext(uint32_t addr, bool write);
+
+  std::vector<Line> lines_;
+  int set_cnt_, assoc_, line_bits_, latency_;
+  ReplacementPolicy replacement_;
+  WritePolicy write_policy_;
+  Cache *next_;
+  int memory_latency_;
+  uint64_t access_cnt_, miss_cnt_;
+  // The state of the xorshift generator that picks random victims, so that runs are reproducible.
+  uint32_t random_state_;
+};
+
+}
+
+#endif //RISC_V_SIMULATOR_CACHE_H
@@ -1,5 +1,7 @@
 #include <iostream>
 
+#include "utils/Serialization.h"
+
 #include "Clock.h"
 
 namespace bubble {
@@ -34,9 +36,26 @@ void Clock::Tick() {
   cycle_++;
 }
 
+void Clock::AdvanceTo(uint32_t cycle) {
+  if (!is_running_ || cycle < cycle_) {
+    return;
+  }
+  cycle_ = cycle;
+}
+
 uint32_t Clock::GetCycleCount() const {
   return cycle_;
 }
 
+void Clock::Serialize(std::ostream &out) const {
+  WriteBinary(out, cycle_);
+  WriteBinary(out, is_running_);
+}
+
+void Clock::Deserialize(std::istream &in) {
+  ReadBinary(in, cycle_);
+  ReadBinary(in, is_running_);
+}
+
 
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define RISC_V_SIMULATOR_CLOCK_H
 
 #include <cstdint>
+#include <iostream>
 #include <string>
 
 namespace bubble {
@@ -16,7 +17,10 @@ class Clock {
   void Reset();
   bool IsRunning() const;
   void Tick();
+  void AdvanceTo(uint32_t cycle);
   uint32_t GetCycleCount() const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
 
  private:
   uint32_t cycle_;
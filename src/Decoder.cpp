@@ -8,23 +8,11 @@
 
 namespace bubble {
 
-Decoder::Decoder(const Clock &clock) : wc_(clock), output_() {}
+namespace {
 
-void Decoder::Debug() const {
-  std::cout << "Decoder:\n";
-  std::cout << "\toutput_ = " << output_.GetCur().ToString() << "\n\n";
-}
-
-bool Decoder::IsStallNeeded(bool is_rb_full, bool is_rs_full, bool is_lsb_full) const {
-  if (!output_.GetCur().get_inst_) {
-    return false;
-  }
-  switch (output_.GetCur().inst_type_) {
-    case kHALT:
-    case kLUI:
-    case kAUIPC:
-    case kJAL:
-      return is_rb_full;
+// Instructions that need neither the RS nor the LSB only take an entry of the RoB.
+bool IsLSBInst(InstType inst_type) {
+  switch (inst_type) {
     case kLB:
     case kLH:
     case kLW:
@@ -33,10 +21,62 @@ bool Decoder::IsStallNeeded(bool is_rb_full, bool is_rs_full, bool is_lsb_full)
     case kSB:
     case kSH:
     case kSW:
-      return is_rb_full || is_lsb_full;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IsRSInst(InstType inst_type) {
+  switch (inst_type) {
+    case kHALT:
+    case kLUI:
+    case kAUIPC:
+    case kJAL:
+      return false;
     default:
-      return is_rb_full || is_rs_full;
+      return !IsLSBInst(inst_type);
+  }
+}
+
+}
+
+Decoder::Decoder(const Clock &clock) : wc_(clock), output_() {}
+
+void Decoder::Debug() const {
+  std::cout << "Decoder:\n";
+  std::cout << "\toutput_ = " << output_.GetCur().ToString() << "\n\n";
+}
+
+// Dispatch is in order: the longest prefix of the bundle for which the RoB, the RS and the LSB all have room.
+int Decoder::GetDispatchCount(int rb_free_cnt, int rs_free_cnt, int lsb_free_cnt) const {
+  const DispatchBundle &bundle = output_.GetCur();
+  int dispatch_cnt = 0;
+  for (; dispatch_cnt < bundle.inst_cnt_ && dispatch_cnt < rb_free_cnt; dispatch_cnt++) {
+    InstType inst_type = bundle.inst_[dispatch_cnt].inst_type_;
+    if (IsRSInst(inst_type) && rs_free_cnt-- == 0) {
+      break;
+    }
+    if (IsLSBInst(inst_type) && lsb_free_cnt-- == 0) {
+      break;
+    }
+  }
+  return dispatch_cnt;
+}
+
+// The IU has to hold the next bundle while a part of this one is still left.
+bool Decoder::IsStallNeeded(int rb_free_cnt, int rs_free_cnt, int lsb_free_cnt) const {
+  return GetDispatchCount(rb_free_cnt, rs_free_cnt, lsb_free_cnt) < output_.GetCur().inst_cnt_;
+}
+
+bool Decoder::HasWork(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb,
+                      const ReservationStation &rs) const {
+  const DispatchBundle &bundle = output_.GetCur();
+  if (!rb.flush_.GetCur().flush_ && bundle.inst_cnt_ != 0 &&
+      GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount()) == 0) {
+    return false;
   }
+  return bundle.inst_cnt_ != 0 || iu.to_decoder_.GetCur()[0].get_inst_;
 }
 
 void Decoder::Update() {
@@ -44,6 +84,16 @@ void Decoder::Update() {
   wc_.Update();
 }
 
+void Decoder::Serialize(std::ostream &out) const {
+  output_.Serialize(out);
+  wc_.Serialize(out);
+}
+
+void Decoder::Deserialize(std::istream &in) {
+  output_.Deserialize(in);
+  wc_.Deserialize(in);
+}
+
 #ifdef _DEBUG
 void Decoder::Execute(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb,
                       const ReservationStation &rs) {
@@ -51,14 +101,16 @@ void Decoder::Execute(const InstructionUnit &iu, const LoadStoreBuffer &lsb, con
     return;
   }
   auto write_func = [this, from_iu = iu.to_decoder_.GetCur(), flush = rb.flush_.GetCur().flush_,
-      is_rb_full = rb.IsFull(), is_rs_full = rs.IsFull(), is_lsb_full = lsb.IsFull()] {
-    bool stall = IsStallNeeded(is_rb_full, is_rs_full, is_lsb_full);
+      rb_free_cnt = rb.GetFreeCount(), rs_free_cnt = rs.GetFreeCount(), lsb_free_cnt = lsb.GetFreeCount()] {
+    int dispatch_cnt = GetDispatchCount(rb_free_cnt, rs_free_cnt, lsb_free_cnt);
     if (flush) {
       Flush();
       return;
     }
-    if (!stall) {
+    if (dispatch_cnt == output_.GetCur().inst_cnt_) {
       WriteOutput(from_iu);
+    } else {
+      KeepRest(dispatch_cnt);
     }
   };
   wc_.Set(write_func, 1);
@@ -71,13 +123,15 @@ void Decoder::Execute(const InstructionUnit &iu, const LoadStoreBuffer &lsb, con
   }
   auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                        RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-    bool stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), lsb.IsFull());
+    int dispatch_cnt = decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount());
     if (rb.flush_.GetCur().flush_) {
       decoder.Flush();
       return;
     }
-    if (!stall) {
+    if (dispatch_cnt == decoder.output_.GetCur().inst_cnt_) {
       decoder.WriteOutput(iu.to_decoder_.GetCur());
+    } else {
+      decoder.KeepRest(dispatch_cnt);
     }
   };
   wc_.Set(write_func, 1);
@@ -287,30 +341,44 @@ bool Decoder::GetInstType(DecoderOutput &out, uint32_t inst) {
 }
 
 void Decoder::Flush() {
-  output_.New().get_inst_ = false;
+  output_.New().inst_cnt_ = 0;
 }
 
-void Decoder::WriteOutput(const IUToDecoder &from_iu) {
-  output_.New().get_inst_ = false;
-  if (!from_iu.get_inst_) {
-    return;
-  }
-  DecoderOutput out;
-  out.addr_ = from_iu.addr_;
-  out.is_jump_predicted_ = from_iu.is_jump_predicted_;
-  bool get_operands_success = GetOperands(out, from_iu.inst_);
-  if (!get_operands_success) {
-    return;
+// An instruction that does not decode is left out of the bundle.
+void Decoder::WriteOutput(const std::array<IUToDecoder, kMaxDispatchWidth> &from_iu) {
+  DispatchBundle bundle;
+  for (int i = 0; i < kMaxDispatchWidth && from_iu[i].get_inst_; i++) {
+    DecoderOutput out;
+    out.addr_ = from_iu[i].addr_;
+    out.is_jump_predicted_ = from_iu[i].is_jump_predicted_;
+    out.predicted_dest_ = from_iu[i].predicted_dest_;
+    if (!GetOperands(out, from_iu[i].inst_) || !GetInstType(out, from_iu[i].inst_)) {
+      continue;
+    }
+    if (out.rd_ >= kXLen || out.rs1_ >= kXLen || out.rs2_ >= kXLen) {
+      continue;
+    }
+    out.get_inst_ = true;
+    bundle.rs_cnt_ += IsRSInst(out.inst_type_);
+    bundle.lsb_cnt_ += IsLSBInst(out.inst_type_);
+    bundle.inst_[bundle.inst_cnt_++] = out;
   }
-  bool get_inst_type_success = GetInstType(out, from_iu.inst_);
-  if (!get_inst_type_success) {
+  output_.Write(bundle);
+}
+
+// The first dispatch_cnt instructions have been dispatched, and the rest moves to the front of the bundle.
+void Decoder::KeepRest(int dispatch_cnt) {
+  if (dispatch_cnt == 0) {
     return;
   }
-  if (out.rd_ >= kXLen || out.rs1_ >= kXLen || out.rs2_ >= kXLen) {
-    return;
+  const DispatchBundle &cur = output_.GetCur();
+  DispatchBundle bundle;
+  for (int i = dispatch_cnt; i < cur.inst_cnt_; i++) {
+    bundle.rs_cnt_ += IsRSInst(cur.inst_[i].inst_type_);
+    bundle.lsb_cnt_ += IsLSBInst(cur.inst_[i].inst_type_);
+    bundle.inst_[bundle.inst_cnt_++] = cur.inst_[i];
   }
-  out.get_inst_ = true;
-  output_.Write(out);
+  output_.Write(bundle);
 }
 
 }
@@ -1,6 +1,7 @@
 #ifndef RISC_V_SIMULATOR_DECODER_H
 #define RISC_V_SIMULATOR_DECODER_H
 
+#include <array>
 #include <cstdint>
 
 #include "utils/Register.h"
@@ -32,7 +33,12 @@ class Decoder {
   Decoder(const Clock &clock);
 
   void Debug() const;
-  bool IsStallNeeded(bool is_rb_full, bool is_rs_full, bool is_lsb_full) const;
+  int GetDispatchCount(int rb_free_cnt, int rs_free_cnt, int lsb_free_cnt) const;
+  bool IsStallNeeded(int rb_free_cnt, int rs_free_cnt, int lsb_free_cnt) const;
+  bool HasWork(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb,
+               const ReservationStation &rs) const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
   void Update();
   void
   Execute(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb, const ReservationStation &rs);
@@ -46,13 +52,15 @@ class Decoder {
                   RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs);
 #endif
 
-  Register<DecoderOutput> output_;
-
- private:
   static bool GetOperands(DecoderOutput &out, uint32_t inst);
   static bool GetInstType(DecoderOutput &out, uint32_t inst);
+
+  Register<DispatchBundle> output_;
+
+ private:
   void Flush();
-  void WriteOutput(const IUToDecoder &from_iu);
+  void WriteOutput(const std::array<IUToDecoder, kMaxDispatchWidth> &from_iu);
+  void KeepRest(int dispatch_cnt);
 
   WriteController wc_;
 };
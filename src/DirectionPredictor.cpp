@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cmath>
+
+#include "utils/Serialization.h"
+
+#include "DirectionPredictor.h"
+
+namespace bubble {
+
+namespace {
+
+void UpdateCounter(uint8_t &counter, bool jump) {
+  if (jump && counter != 0b11) {
+    counter++;
+  }
+  if (!jump && counter != 0b00) {
+    counter--;
+  }
+}
+
+// The last length bits of the history folded into bits bits by xor.
+uint32_t Fold(uint64_t history, int length, int bits) {
+  if (length < 64) {
+    history &= (uint64_t(1) << length) - 1;
+  }
+  uint32_t folded = 0;
+  for (; history != 0; history >>= bits) {
+    folded ^= history & ((uint64_t(1) << bits) - 1);
+  }
+  return folded;
+}
+
+int Log2(int size) {
+  int bits = 0;
+  while ((1 << bits) < size) {
+    bits++;
+  }
+  return bits;
+}
+
+template<class T>
+void WriteVector(std::ostream &out, const std::vector<T> &data) {
+  for (const T &item : data) {
+    WriteBinary(out, item);
+  }
+}
+
+template<class T>
+void ReadVector(std::istream &in, std::vector<T> &data) {
+  for (T &item : data) {
+    ReadBinary(in, item);
+  }
+}
+
+}
+
+std::unique_ptr<DirectionPredictor> DirectionPredictor::Create(const Config &config) {
+  switch (config.bp_type_) {
+    case kGShare:
+      return std::make_unique<GSharePredictor>(config.bp_size_, config.bp_history_);
+    case kTournament:
+      return std::make_unique<TournamentPredictor>(config.bp_size_, config.bp_history_);
+    case kTAGE:
+      return std::make_unique<TAGEPredictor>(config.bp_size_, config.bp_history_);
+    case kPerceptron:
+      return std::make_unique<PerceptronPredictor>(config.bp_size_, config.bp_history_);
+    default:
+      return std::make_unique<BimodalPredictor>(config.bp_size_);
+  }
+}
+
+BimodalPredictor::BimodalPredictor(int size) : size_(size), counters_(size, 0b01) {}
+
+bool BimodalPredictor::Predict(uint32_t pc, uint64_t history) const {
+  return counters_[GetHash(pc)] & 0b10;
+}
+
+void BimodalPredictor::Update(uint32_t pc, uint64_t history, bool jump) {
+  UpdateCounter(counters_[GetHash(pc)], jump);
+}
+
+void BimodalPredictor::Serialize(std::ostream &out) const {
+  WriteVector(out, counters_);
+}
+
+void BimodalPredictor::Deserialize(std::istream &in) {
+  ReadVector(in, counters_);
+}
+
+GSharePredictor::GSharePredictor(int size, int history_length) :
+    size_(size), index_bits_(Log2(size)), history_length_(history_length), counters_(size, 0b01) {}
+
+int GSharePredictor::GetHash(uint32_t pc, uint64_t history) const {
+  return ((pc >> 2) ^ Fold(history, history_length_, std::max(index_bits_, 1))) & (size_ - 1);
+}
+
+bool GSharePredictor::Predict(uint32_t pc, uint64_t history) const {
+  return counters_[GetHash(pc, history)] & 0b10;
+}
+
+void GSharePredictor::Update(uint32_t pc, uint64_t history, bool jump) {
+  UpdateCounter(counters_[GetHash(pc, history)], jump);
+}
+
+void GSharePredictor::Serialize(std::ostream &out) const {
+  WriteVector(out, counters_);
+}
+
+void GSharePredictor::Deserialize(std::istream &in) {
+  ReadVector(in, counters_);
+}
+
+TournamentPredictor::TournamentPredictor(int size, int history_length) :
+    size_(size), bimodal_(size), gshare_(size, history_length), chooser_(size, 0b01) {}
+
+bool TournamentPredictor::Predict(uint32_t pc, uint64_t history) const {
+  if (chooser_[GetHash(pc)] & 0b10) {
+    return gshare_.Predict(pc, history);
+  }
+  return bimodal_.Predict(pc, history);
+}
+
+// The chooser moves towards whichever of the two was right when they disagree.
+void TournamentPredictor::Update(uint32_t pc, uint64_t history, bool jump) {
+  bool bimodal = bimodal_.Predict(pc, history), gshare = gshare_.Predict(pc, history);
+  if (bimodal != gshare) {
+    UpdateCounter(chooser_[GetHash(pc)], gshare == jump);
+  }
+  bimodal_.Update(pc, history, jump);
+  gshare_.Update(pc, history, jump);
+}
+
+void TournamentPredictor::Serialize(std::ostream &out) const {
+  bimodal_.Serialize(out);
+  gshare_.Serialize(out);
+  WriteVector(out, chooser_);
+}
+
+void TournamentPredictor::Deserialize(std::istream &in) {
+  bimodal_.Deserialize(in);
+  gshare_.Deserialize(in);
+  ReadVector(in, chooser_);
+}
+
+TAGEPredictor::TAGEPredictor(int size, int history_length) :
+    size_(size), index_bits_(Log2(size)), base_(size, 0b01), update_cnt_(0) {
+  for (int i = 0; i < kTableCnt; i++) {
+    history_lengths_[i] = std::max(history_length >> (kTableCnt - 1 - i), 1);
+    tables_[i].resize(size);
+  }
+}
+
+int TAGEPredictor::GetIndex(int table, uint32_t pc, uint64_t history) const {
+  int bits = std::max(index_bits_, 1);
+  return ((pc >> 2) ^ (pc >> (2 + bits)) ^ Fold(history, history_lengths_[table], bits)) & (size_ - 1);
+}
+
+uint16_t TAGEPredictor::GetTag(int table, uint32_t pc, uint64_t history) const {
+  uint32_t tag = (pc >> 2) ^ Fold(history, history_lengths_[table], kTagBits) ^
+                 (Fold(history, history_lengths_[table], kTagBits - 1) << 1);
+  return tag & ((1 << kTagBits) - 1);
+}
+
+int TAGEPredictor::FindProvider(uint32_t pc, uint64_t history, bool &alt_prediction) const {
+  int provider = -1;
+  alt_prediction = base_[(pc >> 2) & (size_ - 1)] & 0b10;
+  for (int i = kTableCnt - 1; i >= 0; i--) {
+    const Entry &entry = tables_[i][GetIndex(i, pc, history)];
+    if (!entry.valid_ || entry.tag_ != GetTag(i, pc, history)) {
+      continue;
+    }
+    if (provider == -1) {
+      provider = i;
+    }
+    else {
+      alt_prediction = entry.counter_ >= 0;
+      break;
+    }
+  }
+  return provider;
+}
+
+bool TAGEPredictor::Predict(uint32_t pc, uint64_t history) const {
+  bool alt_prediction;
+  int provider = FindProvider(pc, history, alt_prediction);
+  if (provider == -1) {
+    return alt_prediction;
+  }
+  return tables_[provider][GetIndex(provider, pc, history)].counter_ >= 0;
+}
+
+void TAGEPredictor::Update(uint32_t pc, uint64_t history, bool jump) {
+  bool alt_prediction, prediction;
+  int provider = FindProvider(pc, history, alt_prediction);
+  if (provider == -1) {
+    prediction = alt_prediction;
+    UpdateCounter(base_[(pc >> 2) & (size_ - 1)], jump);
+  }
+  else {
+    Entry &entry = tables_[provider][GetIndex(provider, pc, history)];
+    prediction = entry.counter_ >= 0;
+    if (prediction != alt_prediction) {
+      if (prediction == jump && entry.useful_ != 0b11) {
+        entry.useful_++;
+      }
+      if (prediction != jump && entry.useful_ != 0) {
+        entry.useful_--;
+      }
+    }
+    if (jump && entry.counter_ != 3) {
+      entry.counter_++;
+    }
+    if (!jump && entry.counter_ != -4) {
+      entry.counter_--;
+    }
+  }
+  if (prediction != jump && provider != kTableCnt - 1) {
+    bool allocated = false;
+    for (int i = provider + 1; i < kTableCnt && !allocated; i++) {
+      Entry &entry = tables_[i][GetIndex(i, pc, history)];
+      if (entry.useful_ == 0) {
+        entry = {true, static_cast<int8_t>(jump ? 0 : -1), 0, GetTag(i, pc, history)};
+        allocated = true;
+      }
+    }
+    for (int i = provider + 1; i < kTableCnt && !allocated; i++) {
+      tables_[i][GetIndex(i, pc, history)].useful_--;
+    }
+  }
+  if (++update_cnt_ % kResetInterval == 0) {
+    for (auto &table : tables_) {
+      for (Entry &entry : table) {
+        entry.useful_ = 0;
+      }
+    }
+  }
+}
+
+void TAGEPredictor::Serialize(std::ostream &out) const {
+  WriteVector(out, base_);
+  for (const auto &table : tables_) {
+    WriteVector(out, table);
+  }
+  WriteBinary(out, update_cnt_);
+}
+
+void TAGEPredictor::Deserialize(std::istream &in) {
+  ReadVector(in, base_);
+  for (auto &table : tables_) {
+    ReadVector(in, table);
+  }
+  ReadBinary(in, update_cnt_);
+}
+
+// The threshold is the one found best for the history length by Jimenez and Lin.
+PerceptronPredictor::PerceptronPredictor(int size, int history_length) :
+    size_(size), history_length_(history_length), threshold_(static_cast<int>(1.93 * history_length + 14)),
+    weights_(size * (history_length + 1), 0) {}
+
+int PerceptronPredictor::GetOutput(uint32_t pc, uint64_t history) const {
+  const int8_t *weights = &weights_[GetHash(pc) * (history_length_ + 1)];
+  int output = weights[0];
+  for (int i = 0; i < history_length_; i++) {
+    output += (history >> i & 1) ? weights[i + 1] : -weights[i + 1];
+  }
+  return output;
+}
+
+bool PerceptronPredictor::Predict(uint32_t pc, uint64_t history) const {
+  return GetOutput(pc, history) >= 0;
+}
+
+void PerceptronPredictor::Update(uint32_t pc, uint64_t history, bool jump) {
+  int output = GetOutput(pc, history);
+  if ((output >= 0) == jump && std::abs(output) > threshold_) {
+    return;
+  }
+  int8_t *weights = &weights_[GetHash(pc) * (history_length_ + 1)];
+  for (int i = 0; i <= history_length_; i++) {
+    // A weight goes up when its branch went the same way as this one, the input of the bias being a jump.
+    bool up = (i == 0 || (history >> (i - 1) & 1)) == jump;
+    if (up && weights[i] != 127) {
+      weights[i]++;
+    }
+    if (!up && weights[i] != -128) {
+      weights[i]--;
+    }
+  }
+}
+
+void PerceptronPredictor::Serialize(std::ostream &out) const {
+  WriteVector(out, weights_);
+}
+
+void PerceptronPredictor::Deserialize(std::istream &in) {
+  ReadVector(in, weights_);
+}
+
+}
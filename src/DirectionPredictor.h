@@ -0,0 +1,158 @@
+#ifndef RISC_V_SIMULATOR_DIRECTIONPREDICTOR_H
+#define RISC_V_SIMULATOR_DIRECTIONPREDICTOR_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "config.h"
+
+namespace bubble {
+
+/*
+ * Predicts whether a conditional branch jumps from its pc and the global history, the directions of the last branches
+ * with the latest one in bit 0. Update is given the same history that Predict was given for the branch, so the
+ * predictors do not keep any history of their own. Create builds the one chosen by config.bp_type_.
+ */
+class DirectionPredictor {
+ public:
+  virtual ~DirectionPredictor() = default;
+
+  virtual bool Predict(uint32_t pc, uint64_t history) const = 0;
+  virtual void Update(uint32_t pc, uint64_t history, bool jump) = 0;
+  virtual void Serialize(std::ostream &out) const = 0;
+  virtual void Deserialize(std::istream &in) = 0;
+
+  static std::unique_ptr<DirectionPredictor> Create(const Config &config);
+};
+
+// config.bp_size_ 2-bit saturating counters indexed by the pc without its low 2 bits, which are always 0, ignoring the
+// history.
+class BimodalPredictor : public DirectionPredictor {
+ public:
+  explicit BimodalPredictor(int size);
+
+  bool Predict(uint32_t pc, uint64_t history) const override;
+  void Update(uint32_t pc, uint64_t history, bool jump) override;
+  void Serialize(std::ostream &out) const override;
+  void Deserialize(std::istream &in) override;
+
+ private:
+  int GetHash(uint32_t pc) const {
+    return (pc >> 2) & (size_ - 1);
+  }
+
+  int size_;
+  std::vector<uint8_t> counters_;
+};
+
+// config.bp_size_ 2-bit saturating counters indexed by the pc xor the history.
+class GSharePredictor : public DirectionPredictor {
+ public:
+  GSharePredictor(int size, int history_length);
+
+  bool Predict(uint32_t pc, uint64_t history) const override;
+  void Update(uint32_t pc, uint64_t history, bool jump) override;
+  void Serialize(std::ostream &out) const override;
+  void Deserialize(std::istream &in) override;
+
+ private:
+  int GetHash(uint32_t pc, uint64_t history) const;
+
+  int size_, index_bits_, history_length_;
+  std::vector<uint8_t> counters_;
+};
+
+// A bimodal and a gshare predictor, and config.bp_size_ 2-bit counters indexed by the pc choosing between them.
+class TournamentPredictor : public DirectionPredictor {
+ public:
+  TournamentPredictor(int size, int history_length);
+
+  bool Predict(uint32_t pc, uint64_t history) const override;
+  void Update(uint32_t pc, uint64_t history, bool jump) override;
+  void Serialize(std::ostream &out) const override;
+  void Deserialize(std::istream &in) override;
+
+ private:
+  int GetHash(uint32_t pc) const {
+    return (pc >> 2) & (size_ - 1);
+  }
+
+  int size_;
+  BimodalPredictor bimodal_;
+  GSharePredictor gshare_;
+  // 0b10 and above choose gshare.
+  std::vector<uint8_t> chooser_;
+};
+
+/*
+ * TAGE: a base table of 2-bit counters indexed by the pc and kTableCnt tables tagged with a hash of the pc and the
+ * history, whose history lengths double from config.bp_history_ / 8 up to config.bp_history_. The longest table that
+ * hits provides the prediction. A misprediction allocates an entry in a longer table whose useful counter is 0, and the
+ * useful counters are cleared every kResetInterval updates so that stale entries can be replaced.
+ */
+class TAGEPredictor : public DirectionPredictor {
+ public:
+  TAGEPredictor(int size, int history_length);
+
+  bool Predict(uint32_t pc, uint64_t history) const override;
+  void Update(uint32_t pc, uint64_t history, bool jump) override;
+  void Serialize(std::ostream &out) const override;
+  void Deserialize(std::istream &in) override;
+
+ private:
+  static constexpr int kTableCnt = 4;
+  static constexpr int kTagBits = 8;
+  static constexpr uint64_t kResetInterval = 1 << 18;
+
+  struct Entry {
+    // Whether the entry was ever allocated, since every tag, 0 included, can be the tag of a branch.
+    bool valid_ = false;
+    // A 3-bit signed counter that predicts a jump when it is not negative.
+    int8_t counter_ = 0;
+    uint8_t useful_ = 0;
+    uint16_t tag_ = 0;
+  };
+
+  int GetIndex(int table, uint32_t pc, uint64_t history) const;
+  uint16_t GetTag(int table, uint32_t pc, uint64_t history) const;
+  // The longest table that hits, or -1, and the prediction of the next one that hits or of the base table.
+  int FindProvider(uint32_t pc, uint64_t history, bool &alt_prediction) const;
+
+  int size_, index_bits_;
+  int history_lengths_[kTableCnt];
+  std::vector<uint8_t> base_;
+  std::vector<Entry> tables_[kTableCnt];
+  uint64_t update_cnt_;
+};
+
+/*
+ * config.bp_size_ perceptrons indexed by the pc, each with a bias and a weight for each of the config.bp_history_ bits
+ * of the history. It predicts a jump when the bias plus the weights of the branches that jumped minus the others is
+ * not negative, and trains on a misprediction or when that sum is within the threshold.
+ */
+class PerceptronPredictor : public DirectionPredictor {
+ public:
+  PerceptronPredictor(int size, int history_length);
+
+  bool Predict(uint32_t pc, uint64_t history) const override;
+  void Update(uint32_t pc, uint64_t history, bool jump) override;
+  void Serialize(std::ostream &out) const override;
+  void Deserialize(std::istream &in) override;
+
+ private:
+  int GetOutput(uint32_t pc, uint64_t history) const;
+
+  int GetHash(uint32_t pc) const {
+    return (pc >> 2) & (size_ - 1);
+  }
+
+  int size_, history_length_, threshold_;
+  // The weights of perceptron i are weights_[i * (history_length_ + 1)...], the bias first.
+  std::vector<int8_t> weights_;
+};
+
+}
+
+#endif //RISC_V_SIMULATOR_DIRECTIONPREDICTOR_H
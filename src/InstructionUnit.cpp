@@ -1,3 +1,7 @@
+#include <algorithm>
+
+#include "utils/Serialization.h"
+
 #include "Decoder.h"
 #include "InstructionUnit.h"
 #include "LoadStoreBuffer.h"
@@ -7,30 +11,96 @@
 
 namespace bubble {
 
-InstructionUnit::InstructionUnit(const Clock &clock, const BranchPredictor &bp) :
-    pc_(), iq_(), to_mem_(), to_decoder_(), neglect_(), wc_(clock), bp_(&bp) {}
+InstructionUnit::InstructionUnit(const Clock &clock, const Config &config, BranchPredictor &bp,
+                                 ReturnAddressStack &ras) :
+    pc_(), expected_pc_(), iq_(CircularQueue<InstQueueEntry, kMaxInstQueueSize>(config.inst_queue_size_)),
+    ftq_(CircularQueue<FetchTarget, kMaxFTQSize>(std::max(config.ftq_size_, 1))), to_mem_(), to_decoder_(), neglect_(),
+    wc_(clock), bp_(&bp), ras_(&ras), ftq_size_(config.ftq_size_), fetch_btb_size_(config.fetch_btb_size_),
+    fetch_width_(config.ftq_size_ != 0 ? config.fetch_width_ : 1),
+    dispatch_width_(config.dispatch_width_),
+    fetch_block_size_(config.l1i_size_ != 0 ? std::min(4 * fetch_width_, config.line_size_) : 4 * fetch_width_),
+    fetch_btb_() {}
 
 void InstructionUnit::Debug() const {
   std::cout << "Instruction Unit:\n";
   std::cout << "\tpc_ = " << pc_.GetCur() << "\n";
   std::cout << "\tiq_ = {\n";
-  for (int i = iq_.GetCur().BeginId(); i != iq_.GetCur().EndId(); i = (i + 1) % (kInstQueueSize + 1)) {
+  for (int i = iq_.GetCur().BeginId(); i != iq_.GetCur().EndId(); i = iq_.GetCur().Next(i)) {
     std::cout << "\t" << i << "\t" << iq_.GetCur()[i].ToString() << "\n";
   }
   std::cout << "\t}\n";
+  std::cout << "\tftq_ = {\n";
+  for (int i = ftq_.GetCur().BeginId(); i != ftq_.GetCur().EndId(); i = ftq_.GetCur().Next(i)) {
+    std::cout << "\t" << i << "\t" << ftq_.GetCur()[i].ToString() << "\n";
+  }
+  std::cout << "\t}\n";
   std::cout << "\tto_mem_ = " << to_mem_.GetCur().ToString() << "\n";
-  std::cout << "\tto_decoder_ = " << to_decoder_.GetCur().ToString() << "\n\n";
+  std::cout << "\tto_decoder_ = {\n";
+  for (int i = 0; i < dispatch_width_; i++) {
+    std::cout << "\t" << i << "\t" << to_decoder_.GetCur()[i].ToString() << "\n";
+  }
+  std::cout << "\t}\n\n";
+}
+
+bool InstructionUnit::HasWork(const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory,
+                              const ReorderBuffer &rb, const ReservationStation &rs) const {
+  if (rb.flush_.GetCur().flush_ || neglect_.GetCur() || memory.to_iu_.GetCur().inst_cnt_ != 0) {
+    return true;
+  }
+  if (ftq_size_ == 0 && (iq_.GetCur().Size() <= iq_.GetCur().Capacity() - 3 || to_mem_.GetCur().load_ ||
+                          to_mem_.GetCur().pc_ != pc_.GetCur())) {
+    return true;
+  }
+  // The fetch engine predicts while the FTQ has room and fetches while it has a target that is not fetched.
+  if (ftq_size_ != 0 && (ftq_.GetCur().Size() < ftq_size_ || to_mem_.GetCur().load_ ||
+                         (!iq_.GetCur().IsFull() && !ftq_.GetCur().Back().fetched_))) {
+    return true;
+  }
+  if (decoder.IsStallNeeded(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount())) {
+    return false;
+  }
+  return !iq_.GetCur().IsEmpty() || to_decoder_.GetCur()[0].get_inst_;
 }
 
 void InstructionUnit::Update() {
   pc_.Update();
+  expected_pc_.Update();
   iq_.Update();
+  ftq_.Update();
   to_mem_.Update();
   to_decoder_.Update();
   neglect_.Update();
   wc_.Update();
 }
 
+void InstructionUnit::Serialize(std::ostream &out) const {
+  pc_.Serialize(out);
+  expected_pc_.Serialize(out);
+  iq_.Serialize(out);
+  ftq_.Serialize(out);
+  to_mem_.Serialize(out);
+  to_decoder_.Serialize(out);
+  neglect_.Serialize(out);
+  wc_.Serialize(out);
+  for (int i = 0; i < fetch_btb_size_; i++) {
+    WriteBinary(out, fetch_btb_[i]);
+  }
+}
+
+void InstructionUnit::Deserialize(std::istream &in) {
+  pc_.Deserialize(in);
+  expected_pc_.Deserialize(in);
+  iq_.Deserialize(in);
+  ftq_.Deserialize(in);
+  to_mem_.Deserialize(in);
+  to_decoder_.Deserialize(in);
+  neglect_.Deserialize(in);
+  wc_.Deserialize(in);
+  for (int i = 0; i < fetch_btb_size_; i++) {
+    ReadBinary(in, fetch_btb_[i]);
+  }
+}
+
 #ifdef _DEBUG
 void InstructionUnit::Execute(const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory,
                               const ReorderBuffer &rb, const ReservationStation &rs) {
@@ -38,7 +108,7 @@ void InstructionUnit::Execute(const Decoder &decoder, const LoadStoreBuffer &lsb
     return;
   }
   auto write_func = [this, flush_info = rb.flush_.GetCur(), from_mem = memory.to_iu_.GetCur(),
-      stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), lsb.IsFull())]() {
+      stall = decoder.IsStallNeeded(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount())]() {
     if (flush_info.flush_) {
       Flush(flush_info.pc_);
       return;
@@ -60,7 +130,7 @@ void InstructionUnit::Execute(const Decoder &decoder, const LoadStoreBuffer &lsb
   }
   auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                        RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-    bool stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), lsb.IsFull());
+    bool stall = decoder.IsStallNeeded(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount());
     if (rb.flush_.GetCur().flush_) {
       iu.Flush(rb.flush_.GetCur().pc_);
       return;
@@ -100,43 +170,180 @@ void InstructionUnit::ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu
 
 void InstructionUnit::Flush(uint32_t pc) {
   pc_.Write(pc);
+  expected_pc_.Write(pc);
+  bp_->Flush();
+  if (ras_->IsEnabled()) {
+    ras_->Flush();
+  }
   iq_.New().Clear();
-  to_mem_.Write(IUToMemory(false, 0));
-  to_decoder_.New().get_inst_ = false;
+  ftq_.New().Clear();
+  to_mem_.Write(IUToMemory(false, 0, 0));
+  for (int i = 0; i < dispatch_width_; i++) {
+    to_decoder_.New()[i].get_inst_ = false;
+  }
   neglect_.Write(false);
 }
 
+// Dequeues up to dispatch_width_ instructions, oldest first.
 void InstructionUnit::WriteToDecoder(bool dequeue) {
-  if (dequeue) {
-    const InstQueueEntry &front = iq_.GetCur().Front();
-    to_decoder_.Write(IUToDecoder(true, front.inst_, front.addr_, front.jump_));
-    iq_.New().Dequeue();
-  }
-  else {
-    to_decoder_.New().get_inst_ = false;
+  const auto &iq = iq_.GetCur();
+  int id = iq.BeginId();
+  for (int i = 0; i < dispatch_width_; i++) {
+    if (dequeue && id != iq.EndId()) {
+      const InstQueueEntry &entry = iq[id];
+      to_decoder_.New()[i] = IUToDecoder(true, entry.inst_, entry.addr_, entry.jump_, entry.predicted_dest_);
+      iq_.New().Dequeue();
+      id = iq.Next(id);
+    }
+    else {
+      to_decoder_.New()[i].get_inst_ = false;
+    }
   }
 }
 
 void InstructionUnit::WriteOthers(const MemoryToIU &from_mem) {
+  if (ftq_size_ != 0) {
+    WriteFetchEngine(from_mem);
+    return;
+  }
   if (neglect_.GetCur()) {
     to_mem_.Write(IUToMemory());
     neglect_.Write(false);
     return;
   }
-  bool load_from_mem = (iq_.GetCur().Size() <= kInstQueueSize - 3);
+  if (from_mem.stall_) {
+    // The memory ignores new requests until it delivers the last one, so the request and the pc are kept.
+    return;
+  }
+  bool load_from_mem = (iq_.GetCur().Size() <= iq_.GetCur().Capacity() - 3);
   if (load_from_mem) {
     pc_.Write(pc_.GetCur() + 4);
   }
-  to_mem_.Write(IUToMemory(load_from_mem, pc_.GetCur()));
-  if (from_mem.inst_ != 0) {
-    bool jump = IsJAL(from_mem.inst_) || (IsBranchInst(from_mem.inst_) && bp_->Predict(from_mem.pc_));
-    iq_.New().Enqueue(InstQueueEntry(from_mem.inst_, from_mem.pc_, jump));
+  to_mem_.Write(IUToMemory(load_from_mem, pc_.GetCur(), 1));
+  if (from_mem.inst_cnt_ != 0 && from_mem.pc_ == expected_pc_.GetCur()) {
+    bool jump;
+    uint32_t dest;
+    PredictControl(from_mem.pc_, from_mem.inst_[0], jump, dest);
+    iq_.New().Enqueue(InstQueueEntry(from_mem.inst_[0], from_mem.pc_, jump, jump ? dest : 0));
+    expected_pc_.Write(jump ? dest : from_mem.pc_ + 4);
     if (jump) {
-      pc_.Write(GetJumpOrBranchDest(from_mem.inst_, from_mem.pc_));
+      pc_.Write(dest);
       to_mem_.Write(IUToMemory());
       neglect_.Write(true);
     }
   }
 }
 
-}
\ No newline at end of file
+/*
+ * With an FTQ, pc_ is the next address to predict rather than to fetch. In one cycle the fetch engine checks the
+ * instructions delivered by the memory against the fetch targets they were fetched for, predicts up to fetch_width_
+ * fetch targets from pc_ on with the fetch BTB, stopping after a jump, and sends the oldest fetch targets not fetched
+ * yet to the memory as one request, so that the target of a jump known to the fetch BTB is fetched right after the
+ * jump. A request holds the consecutive fetch targets in one fetch block, so it also ends at a predicted jump. When the
+ * fetch BTB was wrong about a delivered instruction, the predictions made after it are undone, the prediction starts
+ * over from the instruction itself and the rest of the delivered block is dropped.
+ */
+void InstructionUnit::WriteFetchEngine(const MemoryToIU &from_mem) {
+  auto ftq = ftq_.New();
+  const auto &ftq_new = ftq_.GetNew();
+  uint32_t pc = pc_.GetCur(), expected_pc = expected_pc_.GetCur();
+  // A block requested before a jump may still overlap the fetch targets after it, so the instructions of a block
+  // that are not expected are skipped one by one rather than dropping the rest of the block. A zero or undecodable
+  // word is queued like any other and dropped by the decoder.
+  for (int i = 0; i < from_mem.inst_cnt_ && !from_mem.stall_; i++) {
+    uint32_t inst = from_mem.inst_[i], inst_pc = from_mem.pc_ + 4 * i;
+    if (inst_pc != expected_pc || ftq.IsEmpty() || !ftq_new.Front().fetched_ ||
+        ftq_new.Front().pc_ != inst_pc) {
+      continue;
+    }
+    FetchTarget target = ftq_new.Front();
+    ftq.Dequeue();
+    bool redirect = (target.inst_ != inst && (target.inst_ != 0 || IsControlInst(inst)));
+    if (redirect) {
+      bp_->RestoreHistory(target.history_, target.path_history_);
+      ras_->Restore(target.ras_top_, target.ras_addr_);
+      PredictControl(inst_pc, inst, target.jump_, target.target_);
+      ftq.Clear();
+      pc = target.jump_ ? target.target_ : inst_pc + 4;
+    }
+    if (IsControlInst(inst) && fetch_btb_size_ != 0) {
+      fetch_btb_[GetFetchBTBHash(inst_pc)] = {true, inst_pc, inst};
+    }
+    iq_.New().Enqueue(InstQueueEntry(inst, inst_pc, target.jump_, target.jump_ ? target.target_ : 0));
+    expected_pc = target.jump_ ? target.target_ : inst_pc + 4;
+    if (redirect) {
+      break;
+    }
+  }
+  expected_pc_.Write(expected_pc);
+  for (int i = 0; i < fetch_width_ && ftq.Size() < ftq_size_; i++) {
+    FetchTarget target;
+    target.pc_ = pc;
+    target.history_ = bp_->GetHistory();
+    target.path_history_ = bp_->GetPathHistory();
+    target.ras_top_ = ras_->GetTopIndex();
+    target.ras_addr_ = ras_->Top();
+    if (fetch_btb_size_ != 0) {
+      const FetchBTBEntry &entry = fetch_btb_[GetFetchBTBHash(pc)];
+      if (entry.valid_ && entry.pc_ == pc) {
+        target.inst_ = entry.inst_;
+        PredictControl(pc, entry.inst_, target.jump_, target.target_);
+      }
+    }
+    ftq.Enqueue(target);
+    pc = target.jump_ ? target.target_ : pc + 4;
+    if (target.jump_) {
+      break;
+    }
+  }
+  pc_.Write(pc);
+  if (from_mem.stall_) {
+    // The memory ignores new requests until it delivers the last one, so the request is kept.
+    return;
+  }
+  // Every fetch target already fetched and still in the FTQ is delivered later and takes an entry of the IQ.
+  int free_cnt = iq_.GetNew().Capacity() - iq_.GetNew().Size();
+  int begin = ftq.BeginId();
+  for (; begin != ftq.EndId() && ftq_new[begin].fetched_; begin = ftq_new.Next(begin)) {
+    free_cnt--;
+  }
+  if (begin == ftq.EndId() || free_cnt <= 0) {
+    to_mem_.Write(IUToMemory());
+    return;
+  }
+  uint32_t begin_pc = ftq_new[begin].pc_, block = begin_pc & ~(fetch_block_size_ - 1);
+  int inst_cnt = 0;
+  for (int i = begin; i != ftq.EndId() && inst_cnt < std::min(free_cnt, fetch_width_); i = ftq_new.Next(i)) {
+    uint32_t inst_pc = begin_pc + 4 * inst_cnt;
+    if (ftq_new[i].pc_ != inst_pc || (inst_pc & ~(fetch_block_size_ - 1)) != block) {
+      break;
+    }
+    ftq[i].fetched_ = true;
+    inst_cnt++;
+  }
+  to_mem_.Write(IUToMemory(true, begin_pc, inst_cnt));
+}
+
+// Whether the instruction inst at pc is predicted to jump and where to, which moves the speculative branch and path
+// histories and the return address stack.
+void InstructionUnit::PredictControl(uint32_t pc, uint32_t inst, bool &jump, uint32_t &dest) {
+  uint32_t rd = GetSub(inst, 11, 7), rs1 = GetSub(inst, 19, 15);
+  dest = 0;
+  if (IsJALR(inst) && ras_->IsEnabled() && rd == 0 && IsLinkRegister(rs1)) {
+    jump = true;
+    dest = ras_->Top();
+    ras_->Pop();
+  }
+  else if (IsJALR(inst)) {
+    jump = bp_->PredictTarget(pc, dest);
+  }
+  else {
+    jump = IsJAL(inst) || (IsBranchInst(inst) && bp_->Predict(pc));
+    dest = GetJumpOrBranchDest(inst, pc);
+  }
+  if ((IsJAL(inst) || IsJALR(inst)) && ras_->IsEnabled() && IsLinkRegister(rd)) {
+    ras_->Push(pc + 4);
+  }
+}
+
+}
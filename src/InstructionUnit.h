@@ -1,6 +1,7 @@
 #ifndef RISC_V_SIMULATOR_INSTRUCTIONUNIT_H
 #define RISC_V_SIMULATOR_INSTRUCTIONUNIT_H
 
+#include <array>
 #include <cstdint>
 
 #include "utils/CircularQueue.h"
@@ -10,6 +11,7 @@
 #include "BranchPredictor.h"
 #include "Clock.h"
 #include "config.h"
+#include "ReturnAddressStack.h"
 #include "WriteController.h"
 
 namespace bubble {
@@ -22,9 +24,13 @@ class ReservationStation;
 
 class InstructionUnit {
  public:
-  InstructionUnit(const Clock &clock, const BranchPredictor &bp);
+  InstructionUnit(const Clock &clock, const Config &config, BranchPredictor &bp, ReturnAddressStack &ras);
 
   void Debug() const;
+  bool HasWork(const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory, const ReorderBuffer &rb,
+               const ReservationStation &rs) const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
   void Update();
   void Execute(const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory, const ReorderBuffer &rb,
                const ReservationStation &rs);
@@ -39,11 +45,23 @@ class InstructionUnit {
 #endif
 
   Register<uint32_t> pc_;
-  Register<CircularQueue<InstQueueEntry, kInstQueueSize>> iq_;
+  // The pc of the next instruction to enqueue. An instruction delivered by the memory at another pc was requested
+  // before a jump and is dropped.
+  Register<uint32_t> expected_pc_;
+  Register<CircularQueue<InstQueueEntry, kMaxInstQueueSize>> iq_;
+  // The fetch targets predicted from pc_ and not delivered by the memory yet, oldest first. The ones already requested
+  // from the memory are at the front.
+  Register<CircularQueue<FetchTarget, kMaxFTQSize>> ftq_;
   Register<IUToMemory> to_mem_;
-  Register<IUToDecoder> to_decoder_;
+  // The instructions dequeued for the decoder in a cycle, the valid ones first.
+  Register<std::array<IUToDecoder, kMaxDispatchWidth>> to_decoder_;
 
  private:
+  struct FetchBTBEntry {
+    bool valid_ = false;
+    uint32_t pc_ = 0, inst_ = 0;
+  };
+
   static constexpr bool IsBranchInst(uint32_t inst) {
     return (inst & 0b1111111) == 0b1100011;
   }
@@ -52,6 +70,19 @@ class InstructionUnit {
     return (inst & 0b1111111) == 0b1101111;
   }
 
+  static constexpr bool IsJALR(uint32_t inst) {
+    return (inst & 0b1111111) == 0b1100111;
+  }
+
+  static constexpr bool IsControlInst(uint32_t inst) {
+    return IsBranchInst(inst) || IsJAL(inst) || IsJALR(inst);
+  }
+
+  // x1 and x5 hold return addresses by the calling convention.
+  static constexpr bool IsLinkRegister(uint32_t reg) {
+    return reg == 1 || reg == 5;
+  }
+
   static constexpr uint32_t GetJumpOrBranchDest(uint32_t inst, uint32_t pc) {
     return pc + ((inst & 0b1111111) ^ 0b1100011 ?
                  SignExtend((GetSub(inst, 31, 31) << 20) | (GetSub(inst, 19, 12) << 12) | (GetSub(inst, 20, 20) << 11) |
@@ -63,12 +94,27 @@ class InstructionUnit {
   void Flush(uint32_t pc);
   void WriteToDecoder(bool dequeue);
   void WriteOthers(const MemoryToIU &from_mem);
+  void WriteFetchEngine(const MemoryToIU &from_mem);
+  void PredictControl(uint32_t pc, uint32_t inst, bool &jump, uint32_t &dest);
+
+  int GetFetchBTBHash(uint32_t pc) const {
+    return (pc >> 2) & (fetch_btb_size_ - 1);
+  }
 
   WriteController wc_;
-  // Neglect next instruction if the current instruction loaded from memory is JAL, or is a branch instruction and that
-  // the predictor predicts that it will jump.
+  // Neglect next instruction if the current instruction loaded from memory is JAL, is a branch instruction and that
+  // the predictor predicts that it will jump, or is JALR and the predictor has a target for it.
   Register<bool> neglect_;
-  const BranchPredictor *bp_;
+  // Only fetch moves the speculative history of bp_ and pushes and pops ras_, and a flush restores both, so they are
+  // updated in place.
+  BranchPredictor *bp_;
+  ReturnAddressStack *ras_;
+  int ftq_size_, fetch_btb_size_, fetch_width_, dispatch_width_;
+  // The bytes of an aligned fetch block, which the instructions fetched in one cycle never cross.
+  uint32_t fetch_block_size_;
+  // The last control transfer instruction delivered at each pc, which tells the fetch engine where a pc jumps to
+  // before the instruction is fetched. Only predecode writes it, in place.
+  FetchBTBEntry fetch_btb_[kMaxBTBSize];
 };
 
 }
@@ -1,3 +1,5 @@
+#include "utils/NumberOperation.h"
+
 #include "ALU.h"
 #include "Decoder.h"
 #include "LoadStoreBuffer.h"
@@ -8,58 +10,137 @@
 
 namespace bubble {
 
-LoadStoreBuffer::LoadStoreBuffer(const Clock &clock) : lsb_(), to_mem_(), wc_(clock) {}
+namespace {
+
+bool IsStore(InstType inst_type) {
+  return inst_type == kSB || inst_type == kSH || inst_type == kSW;
+}
+
+int GetAccessWidth(InstType inst_type) {
+  switch (inst_type) {
+    case kLB:
+    case kLBU:
+    case kSB:
+      return 1;
+    case kLH:
+    case kLHU:
+    case kSH:
+      return 2;
+    default:
+      return 4;
+  }
+}
+
+// The value a load of inst_type gets from the bytes val at its address.
+uint32_t ExtendLoad(InstType inst_type, uint32_t val) {
+  switch (inst_type) {
+    case kLB:
+      return SignExtend(GetSub(val, 7, 0), 7);
+    case kLH:
+      return SignExtend(GetSub(val, 15, 0), 15);
+    case kLBU:
+      return GetSub(val, 7, 0);
+    case kLHU:
+      return GetSub(val, 15, 0);
+    default:
+      return val;
+  }
+}
+
+}
+
+LoadStoreBuffer::LoadStoreBuffer(const Clock &clock, const Config &config, StoreSetPredictor &ssp) :
+    lsb_(CircularQueue<LSBEntry, kMaxLSBSize>(config.lsb_size_)), to_mem_(), violation_id_(-1), wc_(clock),
+    ssp_(&ssp) {}
 
 void LoadStoreBuffer::Debug() const {
   std::cout << "Load/Store Buffer:\n";
   std::cout << "\tlsb_ = {\n";
-  for (int i = lsb_.GetCur().BeginId(); i != lsb_.GetCur().EndId(); i = (i + 1) % (kLSBSize + 1)) {
+  for (int i = lsb_.GetCur().BeginId(); i != lsb_.GetCur().EndId(); i = lsb_.GetCur().Next(i)) {
     std::cout << "\t" << i << "\t" << lsb_.GetCur()[i].ToString() << "\n";
   }
   std::cout << "\t}\n";
-  std::cout << "\tto_mem_ = " << to_mem_.GetCur().ToString() << "\n\n";
+  std::cout << "\tto_mem_ = " << to_mem_.GetCur().ToString() << "\n";
+  std::cout << "\tviolation_id_ = " << violation_id_.GetCur() << "\n\n";
 }
 
-bool LoadStoreBuffer::IsFull() const {
-  return lsb_.GetCur().IsFull();
+int LoadStoreBuffer::GetFreeCount() const {
+  return lsb_.GetCur().Capacity() - lsb_.GetCur().Size();
+}
+
+bool LoadStoreBuffer::HasWork(const ALU &alu, const Decoder &decoder, const Memory &memory, const ReorderBuffer &rb,
+                              const ReservationStation &rs) const {
+  if (rb.flush_.GetCur().flush_ || rb.to_mem_.GetCur().store_ || to_mem_.GetCur().load_ ||
+      violation_id_.GetCur() != -1) {
+    return true;
+  }
+  if (decoder.output_.GetCur().lsb_cnt_ != 0 &&
+      decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), GetFreeCount()) != 0) {
+    return true;
+  }
+  LSBToMemory request;
+  bool speculative;
+  if (!memory.IsDataBusy(*this, rb, true) && SelectLoad(memory, request, speculative) != -1) {
+    return true;
+  }
+  CommonDataBus cdb = alu.GetCommonDataBus(memory);
+  if (!cdb.HasResult()) {
+    return false;
+  }
+  for (int i = lsb_.GetCur().BeginId(); i != lsb_.GetCur().EndId(); i = lsb_.GetCur().Next(i)) {
+    const LSBEntry &entry = lsb_.GetCur()[i];
+    uint32_t val;
+    if (cdb.Find(entry.Q1_, val) || cdb.Find(entry.Q2_, val)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void LoadStoreBuffer::Update() {
   lsb_.Update();
   to_mem_.Update();
+  violation_id_.Update();
   wc_.Update();
 }
 
+void LoadStoreBuffer::Serialize(std::ostream &out) const {
+  lsb_.Serialize(out);
+  to_mem_.Serialize(out);
+  violation_id_.Serialize(out);
+  wc_.Serialize(out);
+}
+
+void LoadStoreBuffer::Deserialize(std::istream &in) {
+  lsb_.Deserialize(in);
+  to_mem_.Deserialize(in);
+  violation_id_.Deserialize(in);
+  wc_.Deserialize(in);
+}
+
 #ifdef _DEBUG
 void LoadStoreBuffer::Execute(const ALU &alu, const Decoder &decoder, const Memory &memory, const ReorderBuffer &rb,
                               const RegisterFile &rf, const ReservationStation &rs) {
   if (wc_.IsBusy()) {
     return;
   }
-  auto write_func = [this, flush = rb.flush_.GetCur().flush_, reg_value = rf.GetRegisterValue(rb),
-      reg_status = rf.GetRegisterStatus(rb), rb_to_mem = rb.to_mem_.GetCur(), rb_queue = rb.GetRB(memory, alu),
-      from_decoder = decoder.output_.GetCur(), from_mem = memory.output_.GetCur(), from_alu = alu.output_.GetCur(),
-      is_mem_busy = memory.IsDataBusy(), stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), IsFull())]() {
+  auto write_func = [this, flush = rb.flush_.GetCur().flush_, rf = &rf, rb = &rb, memory = &memory,
+      rb_to_mem = rb.to_mem_.GetCur(), fwd = rb.GetForwardingView(memory, alu),
+      from_decoder = decoder.output_.GetCur(), cdb = alu.GetCommonDataBus(memory),
+      is_mem_busy = memory.IsDataBusy(*this, rb, true),
+      dispatch_cnt = decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), GetFreeCount())]() {
     if (flush) {
       Flush();
       return;
     }
-    const LSBEntry &lsb_front = lsb_.GetCur().Front();
-    const InstType &from_decoder_inst_type = from_decoder.inst_type_;
-    bool is_front_load = !lsb_.GetCur().IsEmpty() &&
-                         (lsb_front.inst_type_ == kLB || lsb_front.inst_type_ == kLH || lsb_front.inst_type_ == kLW ||
-                          lsb_front.inst_type_ == kLBU || lsb_front.inst_type_ == kLHU);
-    bool is_new_inst_load = (from_decoder_inst_type == kLB || from_decoder_inst_type == kLH ||
-                             from_decoder_inst_type == kLW || from_decoder_inst_type == kLBU ||
-                             from_decoder_inst_type == kLHU);
-    bool is_new_inst_store = (from_decoder_inst_type == kSB || from_decoder_inst_type == kSH ||
-                              from_decoder_inst_type == kSW);
-    EnqueueInst(stall, is_new_inst_store, is_new_inst_load, from_decoder, reg_value, reg_status, rb_queue);
-    UpdateDependencies(from_mem, from_alu);
-    bool dequeue_load = WriteToMemory(is_front_load, is_mem_busy);
-    if (dequeue_load || rb_to_mem.store_) {
-      lsb_.New().Dequeue();
+    EnqueueInst(dispatch_cnt, from_decoder, *rf, *rb, fwd);
+    UpdateDependencies(cdb);
+    int issued_id = WriteToMemory(*memory, is_mem_busy);
+    if (issued_id != -1) {
+      lsb_.New()[issued_id].issued_ = true;
     }
+    CheckResolvedStores();
+    DequeueFinished(rb_to_mem.store_);
   };
   wc_.Set(write_func, 1);
 }
@@ -72,27 +153,19 @@ void LoadStoreBuffer::Execute(const ALU &alu, const Decoder &decoder, const Memo
   }
   auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                        RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-    bool stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), lsb.IsFull());
+    int dispatch_cnt = decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount());
     if (rb.flush_.GetCur().flush_) {
       lsb.Flush();
       return;
     }
-    const LSBEntry &lsb_front = lsb.lsb_.GetCur().Front();
-    const InstType &from_decoder_inst_type = decoder.output_.GetCur().inst_type_;
-    bool is_front_load = !lsb.lsb_.GetCur().IsEmpty() &&
-                         (lsb_front.inst_type_ == kLB || lsb_front.inst_type_ == kLH || lsb_front.inst_type_ == kLW ||
-                          lsb_front.inst_type_ == kLBU || lsb_front.inst_type_ == kLHU);
-    bool is_new_inst_load = (from_decoder_inst_type == kLB || from_decoder_inst_type == kLH ||
-                             from_decoder_inst_type == kLW || from_decoder_inst_type == kLBU ||
-                             from_decoder_inst_type == kLHU);
-    bool is_new_inst_store = (from_decoder_inst_type == kSB || from_decoder_inst_type == kSH ||
-                              from_decoder_inst_type == kSW);
-    lsb.EnqueueInst(stall, is_new_inst_store, is_new_inst_load, decoder.output_.GetCur(), rf, rb, memory, alu);
-    lsb.UpdateDependencies(memory.output_.GetCur(), alu.output_.GetCur());
-    bool dequeue_load = lsb.WriteToMemory(is_front_load, memory.IsDataBusy());
-    if (dequeue_load || rb.to_mem_.GetCur().store_) {
-      lsb.lsb_.New().Dequeue();
+    lsb.EnqueueInst(dispatch_cnt, decoder.output_.GetCur(), rf, rb, rb.GetForwardingView(memory, alu));
+    lsb.UpdateDependencies(alu.GetCommonDataBus(memory));
+    int issued_id = lsb.WriteToMemory(memory, memory.IsDataBusy(lsb, rb, true));
+    if (issued_id != -1) {
+      lsb.lsb_.New()[issued_id].issued_ = true;
     }
+    lsb.CheckResolvedStores();
+    lsb.DequeueFinished(rb.to_mem_.GetCur().store_);
   };
   wc_.Set(write_func, 1);
 }
@@ -122,128 +195,184 @@ void LoadStoreBuffer::ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu
 void LoadStoreBuffer::Flush() {
   lsb_.New().Clear();
   to_mem_.New().load_ = false;
+  violation_id_.New() = -1;
+  ssp_->Flush();
 }
 
-void LoadStoreBuffer::EnqueueInst(bool stall, bool is_new_inst_store, bool is_new_inst_load,
-                                  const DecoderOutput &from_decoder, const std::array<uint32_t, kXLen> &reg_value,
-                                  const std::array<int, kXLen> &reg_status,
-                                  const CircularQueue<RoBEntry, kRoBSize> &rb_queue) {
-  if (stall || !from_decoder.get_inst_ || (!is_new_inst_store && !is_new_inst_load)) {
+void LoadStoreBuffer::EnqueueInst(int dispatch_cnt, const DispatchBundle &from_decoder, const RegisterFile &rf,
+                                  const ReorderBuffer &rb, const ForwardingView &fwd) {
+  if (dispatch_cnt == 0 || from_decoder.lsb_cnt_ == 0) {
     return;
   }
-  LSBEntry lsb_entry;
-  lsb_entry.inst_type_ = from_decoder.inst_type_;
-  lsb_entry.id_ = rb_queue.EndId();
-  lsb_entry.Q1_ = reg_status[from_decoder.rs1_];
-  if (lsb_entry.Q1_ == -1) {
-    lsb_entry.V1_ = reg_value[from_decoder.rs1_] + from_decoder.imm_;
-  }
-  else {
-    if (rb_queue[lsb_entry.Q1_].done_) {
-      lsb_entry.V1_ = rb_queue[lsb_entry.Q1_].val_ + from_decoder.imm_;
-      lsb_entry.Q1_ = -1;
-    }
-    else {
-      lsb_entry.V1_ = from_decoder.imm_;
+  for (int k = 0; k < dispatch_cnt; k++) {
+    const DecoderOutput &inst = from_decoder.inst_[k];
+    bool is_new_inst_load = (inst.inst_type_ == kLB || inst.inst_type_ == kLH || inst.inst_type_ == kLW ||
+                             inst.inst_type_ == kLBU || inst.inst_type_ == kLHU);
+    bool is_new_inst_store = IsStore(inst.inst_type_);
+    if (!is_new_inst_load && !is_new_inst_store) {
+      continue;
     }
-  }
-  if (is_new_inst_load) {
-    lsb_entry.Q2_ = -1;
-  }
-  if (is_new_inst_store) {
-    lsb_entry.Q2_ = reg_status[from_decoder.rs2_];
-    if (lsb_entry.Q2_ == -1) {
-      lsb_entry.V2_ = reg_value[from_decoder.rs2_];
+    LSBEntry lsb_entry;
+    lsb_entry.inst_type_ = inst.inst_type_;
+    lsb_entry.id_ = fwd.GetNewId(k);
+    lsb_entry.pc_ = inst.addr_;
+    uint32_t base = 0;
+    lsb_entry.Q1_ = rf.ReadOperand(inst.rs1_, from_decoder, k, rb, fwd, base);
+    lsb_entry.V1_ = base + inst.imm_;
+    if (is_new_inst_load) {
+      lsb_entry.Q2_ = -1;
+      lsb_entry.dep_id_ = ssp_->GetLastStore(lsb_entry.pc_);
     }
-    else {
-      if (rb_queue[lsb_entry.Q2_].done_) {
-        lsb_entry.V2_ = rb_queue[lsb_entry.Q2_].val_;
-        lsb_entry.Q2_ = -1;
+    if (is_new_inst_store) {
+      lsb_entry.Q2_ = rf.ReadOperand(inst.rs2_, from_decoder, k, rb, fwd, lsb_entry.V2_);
+      if (lsb_entry.Q1_ != -1) {
+        ssp_->AddStore(lsb_entry.pc_, lsb_entry.id_);
       }
     }
+    lsb_.New().Enqueue(lsb_entry);
   }
-  lsb_.New().Enqueue(lsb_entry);
 }
 
-void LoadStoreBuffer::EnqueueInst(bool stall, bool is_new_inst_store, bool is_new_inst_load,
-                                  const DecoderOutput &from_decoder, const RegisterFile &rf, const ReorderBuffer &rb,
-                                  const Memory &memory, const ALU &alu) {
-  if (stall || !from_decoder.get_inst_ || (!is_new_inst_store && !is_new_inst_load)) {
-    return;
-  }
-  LSBEntry lsb_entry;
-  lsb_entry.inst_type_ = from_decoder.inst_type_;
-  lsb_entry.id_ = rb.rb_.GetCur().EndId();
-  lsb_entry.Q1_ = rf.GetRegisterStatus(from_decoder.rs1_, rb);
-  if (lsb_entry.Q1_ == -1) {
-    lsb_entry.V1_ = rf.GetRegisterValue(from_decoder.rs1_, rb) + from_decoder.imm_;
-  }
-  else {
-    RoBEntry rb_Q1 = rb.GetRB(lsb_entry.Q1_, memory, alu);
-    if (rb_Q1.done_) {
-      lsb_entry.V1_ = rb_Q1.val_ + from_decoder.imm_;
-      lsb_entry.Q1_ = -1;
+void LoadStoreBuffer::UpdateDependencies(const CommonDataBus &cdb) {
+  cdb.ForEachResult([this](int id, uint32_t val) {
+    for (int i = lsb_.GetNew().BeginId(); i != lsb_.GetNew().EndId(); i = lsb_.GetNew().Next(i)) {
+      if (lsb_.GetNew()[i].Q1_ == id) {
+        lsb_.New()[i].Q1_ = -1;
+        lsb_.New()[i].V1_ += val;
+      }
+      if (lsb_.GetNew()[i].Q2_ == id) {
+        lsb_.New()[i].Q2_ = -1;
+        lsb_.New()[i].V2_ = val;
+      }
     }
-    else {
-      lsb_entry.V1_ = from_decoder.imm_;
+  });
+}
+
+// The oldest load whose address is known and which does not have to wait for an older store. Going from the youngest
+// older store to the oldest, the load waits for a store with an unknown address if it is the one the store-set
+// predictor ties the load to (or for any such store if the predictor is off) and goes ahead of it otherwise. The first
+// store it overlaps ends the search: the load waits for that store to commit, unless the two have the same address and
+// width and the data of the store is ready, in which case the data is forwarded to the load. A load that overlaps no
+// store in the LSB takes its data from the store buffer of the memory if all of its bytes are there and waits for the
+// buffer to drain if only some are. Returns the index of the load and the request for it, or -1; speculative tells
+// whether the load goes ahead of a store with an unknown address.
+int LoadStoreBuffer::SelectLoad(const Memory &memory, LSBToMemory &request, bool &speculative) const {
+  const auto &lsb = lsb_.GetCur();
+  std::array<int, kMaxLSBSize> stores;
+  int store_cnt = 0;
+  for (int i = lsb.BeginId(); i != lsb.EndId(); i = lsb.Next(i)) {
+    const LSBEntry &entry = lsb[i];
+    if (IsStore(entry.inst_type_)) {
+      stores[store_cnt++] = i;
+      continue;
     }
-  }
-  if (is_new_inst_load) {
-    lsb_entry.Q2_ = -1;
-  }
-  if (is_new_inst_store) {
-    lsb_entry.Q2_ = rf.GetRegisterStatus(from_decoder.rs2_, rb);
-    if (lsb_entry.Q2_ == -1) {
-      lsb_entry.V2_ = rf.GetRegisterValue(from_decoder.rs2_, rb);
+    if (entry.issued_ || entry.Q1_ != -1) {
+      continue;
+    }
+    int width = GetAccessWidth(entry.inst_type_), j = store_cnt - 1;
+    bool wait = false;
+    speculative = false;
+    for (; j >= 0; j--) {
+      const LSBEntry &store = lsb[stores[j]];
+      if (store.Q1_ != -1) {
+        wait = !ssp_->IsEnabled() || store.id_ == entry.dep_id_;
+        speculative = true;
+      }
+      else if (store.V1_ < entry.V1_ + width && entry.V1_ < store.V1_ + GetAccessWidth(store.inst_type_)) {
+        break;
+      }
+      if (wait) {
+        break;
+      }
+    }
+    if (wait) {
+      continue;
+    }
+    request = LSBToMemory();
+    if (j >= 0) {
+      const LSBEntry &store = lsb[stores[j]];
+      if (store.V1_ != entry.V1_ || GetAccessWidth(store.inst_type_) != width || store.Q2_ != -1) {
+        continue;
+      }
+      request.forwarded_ = true;
+      request.val_ = ExtendLoad(entry.inst_type_, store.V2_);
     }
     else {
-      RoBEntry rb_Q2 = rb.GetRB(lsb_entry.Q2_, memory, alu);
-      if (rb_Q2.done_) {
-        lsb_entry.V2_ = rb_Q2.val_;
-        lsb_entry.Q2_ = -1;
+      uint32_t val;
+      int byte_cnt = memory.ReadStoreBuffer(entry.V1_, width, val);
+      if (byte_cnt != 0 && byte_cnt != width) {
+        continue;
       }
+      request.forwarded_ = (byte_cnt == width);
+      request.val_ = ExtendLoad(entry.inst_type_, val);
     }
+    request.load_ = true;
+    request.load_addr_ = entry.V1_;
+    request.inst_type_ = entry.inst_type_;
+    request.id_ = entry.id_;
+    return i;
   }
-  lsb_.New().Enqueue(lsb_entry);
+  return -1;
 }
 
-void LoadStoreBuffer::UpdateDependencies(const MemoryOutput &from_mem, const ALUOutput &from_alu) {
-  if (from_mem.done_) {
-    for (int i = lsb_.New().BeginId(); i != lsb_.New().EndId(); i = (i + 1) % (kLSBSize + 1)) {
-      if (lsb_.New()[i].Q1_ == from_mem.id_) {
-        lsb_.New()[i].Q1_ = -1;
-        lsb_.New()[i].V1_ += from_mem.val_;
-      }
-      if (lsb_.New()[i].Q2_ == from_mem.id_) {
-        lsb_.New()[i].Q2_ = -1;
-        lsb_.New()[i].V2_ = from_mem.val_;
-      }
+// Returns the index of the load sent to the memory, or -1.
+int LoadStoreBuffer::WriteToMemory(const Memory &memory, bool is_mem_busy) {
+  to_mem_.New() = LSBToMemory();
+  LSBToMemory request;
+  bool speculative = false;
+  int id = (is_mem_busy ? -1 : SelectLoad(memory, request, speculative));
+  if (id != -1) {
+    to_mem_.New() = request;
+    ssp_->CountLoad(speculative);
+  }
+  return id;
+}
+
+// A load that went ahead of a store whose address became known in this cycle read memory too early if that store is
+// the youngest older store it overlaps. The oldest such load is reported to the RoB, which fetches it again, and the
+// store-set predictor learns every such pair.
+void LoadStoreBuffer::CheckResolvedStores() {
+  violation_id_.New() = -1;
+  const auto &cur = lsb_.GetCur();
+  const auto &lsb = lsb_.GetNew();
+  for (int i = cur.BeginId(); i != cur.EndId(); i = cur.Next(i)) {
+    if (IsStore(cur[i].inst_type_) && cur[i].Q1_ != -1 && lsb[i].Q1_ == -1) {
+      ssp_->ResolveStore(lsb[i].pc_, lsb[i].id_);
     }
   }
-  if (from_alu.done_) {
-    for (int i = lsb_.New().BeginId(); i != lsb_.New().EndId(); i = (i + 1) % (kLSBSize + 1)) {
-      if (lsb_.New()[i].Q1_ == from_alu.id_) {
-        lsb_.New()[i].Q1_ = -1;
-        lsb_.New()[i].V1_ += from_alu.val_;
-      }
-      if (lsb_.New()[i].Q2_ == from_alu.id_) {
-        lsb_.New()[i].Q2_ = -1;
-        lsb_.New()[i].V2_ = from_alu.val_;
+  for (int i = cur.BeginId(); i != cur.EndId(); i = cur.Next(i)) {
+    const LSBEntry &load = lsb[i];
+    if (IsStore(load.inst_type_) || !load.issued_) {
+      continue;
+    }
+    int width = GetAccessWidth(load.inst_type_), store_index = -1;
+    for (int j = i; j != cur.BeginId() && store_index == -1;) {
+      j = cur.Prev(j);
+      const LSBEntry &store = lsb[j];
+      if (IsStore(store.inst_type_) && store.Q1_ == -1 && store.V1_ < load.V1_ + width &&
+          load.V1_ < store.V1_ + GetAccessWidth(store.inst_type_)) {
+        store_index = j;
       }
     }
+    if (store_index == -1 || cur[store_index].Q1_ == -1) {
+      continue;
+    }
+    ssp_->Update(load.pc_, lsb[store_index].pc_);
+    if (violation_id_.GetNew() == -1) {
+      violation_id_.New() = load.id_;
+    }
   }
 }
 
-bool LoadStoreBuffer::WriteToMemory(bool is_front_load, bool is_mem_busy) {
-  to_mem_.New().load_ = false;
-  if (!is_front_load || is_mem_busy || to_mem_.GetCur().load_ || lsb_.GetCur().Front().Q1_ != -1) {
-    return false;
+// A store leaves when the ROB commits it, which it does only at the front, and the loads sent to the memory leave as
+// soon as nothing older is left.
+void LoadStoreBuffer::DequeueFinished(bool is_store_committed) {
+  if (is_store_committed) {
+    lsb_.New().Dequeue();
+  }
+  while (!lsb_.GetNew().IsEmpty() && lsb_.GetNew().Front().issued_) {
+    lsb_.New().Dequeue();
   }
-  to_mem_.New().load_ = true;
-  to_mem_.New().load_addr_ = lsb_.GetCur().Front().V1_;
-  to_mem_.New().inst_type_ = lsb_.GetCur().Front().inst_type_;
-  to_mem_.New().id_ = lsb_.GetCur().Front().id_;
-  return true;
 }
 
 }
\ No newline at end of file
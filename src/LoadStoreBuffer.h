@@ -8,20 +8,25 @@
 
 #include "Clock.h"
 #include "config.h"
+#include "StoreSetPredictor.h"
 #include "WriteController.h"
 
 namespace bubble {
 
 #ifdef _DEBUG
 class ALU;
+class CommonDataBus;
 class Decoder;
+class ForwardingView;
 class Memory;
 class RegisterFile;
 class ReorderBuffer;
 class ReservationStation;
 #else
 class ALU;
+class CommonDataBus;
 class Decoder;
+class ForwardingView;
 class InstructionUnit;
 class LoadStoreBuffer;
 class Memory;
@@ -32,10 +37,14 @@ class ReservationStation;
 
 class LoadStoreBuffer {
  public:
-  LoadStoreBuffer(const Clock &clock);
+  LoadStoreBuffer(const Clock &clock, const Config &config, StoreSetPredictor &ssp);
 
   void Debug() const;
-  bool IsFull() const;
+  int GetFreeCount() const;
+  bool HasWork(const ALU &alu, const Decoder &decoder, const Memory &memory, const ReorderBuffer &rb,
+               const ReservationStation &rs) const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
   void Update();
   void Execute(const ALU &alu, const Decoder &decoder, const Memory &memory, const ReorderBuffer &rb,
                const RegisterFile &rf, const ReservationStation &rs);
@@ -49,20 +58,23 @@ class LoadStoreBuffer {
                   RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs);
 #endif
 
-  Register<CircularQueue<LSBEntry, kLSBSize>> lsb_;
+  Register<CircularQueue<LSBEntry, kMaxLSBSize>> lsb_;
   Register<LSBToMemory> to_mem_;
+  // The RoB id of a load found to have read memory too early, or -1.
+  Register<int> violation_id_;
 
  private:
   void Flush();
-  void EnqueueInst(bool stall, bool is_new_inst_store, bool is_new_inst_load, const DecoderOutput &from_decoder,
-                   const std::array<uint32_t, kXLen> &reg_value, const std::array<int, kXLen> &reg_status,
-                   const CircularQueue<RoBEntry, kRoBSize> &rb_queue);
-  void EnqueueInst(bool stall, bool is_new_inst_store, bool is_new_inst_load, const DecoderOutput &from_decoder,
-                   const RegisterFile &rf, const ReorderBuffer &rb, const Memory &memory, const ALU &alu);
-  void UpdateDependencies(const MemoryOutput &from_mem, const ALUOutput &from_alu);
-  bool WriteToMemory(bool is_front_load, bool is_mem_busy);
+  void EnqueueInst(int dispatch_cnt, const DispatchBundle &from_decoder, const RegisterFile &rf,
+                   const ReorderBuffer &rb, const ForwardingView &fwd);
+  void UpdateDependencies(const CommonDataBus &cdb);
+  int SelectLoad(const Memory &memory, LSBToMemory &request, bool &speculative) const;
+  int WriteToMemory(const Memory &memory, bool is_mem_busy);
+  void CheckResolvedStores();
+  void DequeueFinished(bool is_store_committed);
 
   WriteController wc_;
+  StoreSetPredictor *ssp_;
 };
 
 }
@@ -1,6 +1,9 @@
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "utils/NumberOperation.h"
 
@@ -11,16 +14,39 @@
 
 namespace bubble {
 
-Memory::Memory(const Clock &clock) :
-    output_(), to_iu_(), memory_(), wc_data_(clock), wc_inst_(clock), is_load_(false) {}
+namespace {
+
+// Every page missing from the page table reads as this one.
+const MemoryPage kZeroPage{};
+
+}
+
+Memory::Memory(const Clock &clock, const Config &config) :
+    output_(), to_iu_(),
+    store_buffer_(CircularQueue<StoreBufferEntry, kMaxStoreBufferSize>(std::max(config.store_buffer_size_, 1))),
+    page_table_(), fetch_cache_(), data_cache_(), wc_data_(clock), wc_inst_(clock), latency_(config.memory_latency_),
+    l2_(config.l2_size_, config.l2_assoc_, config.line_size_, config.l2_latency_, config.cache_replacement_,
+        config.cache_write_policy_, nullptr, config.memory_latency_),
+    l1i_(config.l1i_size_, config.l1i_assoc_, config.line_size_, config.l1i_latency_, config.cache_replacement_,
+         config.cache_write_policy_, &l2_, config.memory_latency_),
+    l1d_(config.l1d_size_, config.l1d_assoc_, config.line_size_, config.l1d_latency_, config.cache_replacement_,
+         config.cache_write_policy_, &l2_, config.memory_latency_), mshrs_(), mshr_cnt_(config.mshr_cnt_),
+    busy_mshr_cnt_(0), store_buffer_size_(config.store_buffer_size_), fetch_request_() {}
 
 void Memory::Debug() const {
   std::cout << "Memory:\n";
   std::cout << "\tto_iu_ = " << to_iu_.GetCur().ToString() << "\n";
-  std::cout << "\toutput_ = " << output_.GetCur().ToString() << "\n\n";
+  std::cout << "\toutput_ = " << output_.GetCur().ToString() << "\n";
+  std::cout << "\tstore_buffer_ = {\n";
+  const auto &store_buffer = store_buffer_.GetCur();
+  for (int i = store_buffer.BeginId(); i != store_buffer.EndId(); i = store_buffer.Next(i)) {
+    std::cout << "\t" << i << "\t" << store_buffer[i].ToString() << "\n";
+  }
+  std::cout << "\t}\n\n";
 }
 
-void Memory::Init(std::istream &in) {
+MemoryImage Memory::ParseImage(std::istream &in) {
+  MemoryImage image;
   std::string str;
   uint32_t now = 0;
   while (std::getline(in, str)) {
@@ -35,97 +61,239 @@ void Memory::Init(std::istream &in) {
     is >> std::hex;
     int num;
     while (is >> num) {
-      StoreByte(now++, num);
+      auto &page = image[now / kPageSize];
+      if (page == nullptr) {
+        page = std::make_shared<MemoryPage>();
+      }
+      (*page)[now % kPageSize] = num;
+      now++;
     }
   }
+  return image;
+}
+
+void Memory::Init(std::istream &in) {
+  Init(ParseImage(in));
+}
+
+void Memory::Init(const MemoryImage &image) {
+  ClearPages();
+  for (const auto &page : image) {
+    SetPage(page.first, page.second);
+  }
 }
 
-bool Memory::IsDataBusy() const {
-  return wc_data_.IsBusy();
+// An access sent in this cycle gets a register in the next one, so the accesses the memory takes in this cycle count
+// as busy for whichever unit asks first. The LSB and the ROB may send an access in the same cycle, so a load also
+// leaves a register for the store the ROB is about to commit. With a store buffer, a store only needs two free entries
+// in it (it may cross a word), and a load leaves a register for the store buffer, which drains before loads.
+bool Memory::IsDataBusy(const LoadStoreBuffer &lsb, const ReorderBuffer &rb, bool is_load) const {
+  if (store_buffer_size_ == 0) {
+    return busy_mshr_cnt_ + lsb.to_mem_.GetCur().load_ + rb.to_mem_.GetCur().store_ +
+           (is_load && rb.IsStoreReady()) >= mshr_cnt_;
+  }
+  if (!is_load) {
+    return store_buffer_.GetCur().Size() + 2 * (rb.to_mem_.GetCur().store_ + 1) > store_buffer_size_;
+  }
+  return busy_mshr_cnt_ + lsb.to_mem_.GetCur().load_ + !store_buffer_.GetCur().IsEmpty() >= mshr_cnt_;
 }
 
 bool Memory::IsInstReady() const {
   return wc_inst_.IsReady();
 }
 
+// The number of bytes of the access of width bytes at addr that are in the store buffer, with those bytes in val at
+// their place in the access.
+int Memory::ReadStoreBuffer(uint32_t addr, int width, uint32_t &val) const {
+  const auto &store_buffer = store_buffer_.GetCur();
+  int byte_cnt = 0;
+  val = 0;
+  for (int i = store_buffer.BeginId(); i != store_buffer.EndId(); i = store_buffer.Next(i)) {
+    const StoreBufferEntry &entry = store_buffer[i];
+    for (int j = 0; j < width; j++) {
+      uint32_t offset = (addr + j) % 4;
+      if (addr + j - offset == entry.addr_ && (entry.mask_ >> offset & 1)) {
+        val |= GetSub(entry.val_, 8 * offset + 7, 8 * offset) << 8 * j;
+        byte_cnt++;
+      }
+    }
+  }
+  return byte_cnt;
+}
+
+bool Memory::HasWork(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb) const {
+  if (iu.to_mem_.GetCur().load_ || to_iu_.GetCur().inst_cnt_ != 0 || to_iu_.GetCur().pc_ != 0) {
+    return true;
+  }
+  if (wc_inst_.IsWritePending() &&
+      (wc_inst_.clock_->GetCycleCount() == wc_inst_.GetWriteCycle() || rb.flush_.GetCur().flush_)) {
+    return true;
+  }
+  if (lsb.to_mem_.GetCur().load_ || rb.to_mem_.GetCur().store_ || output_.GetCur().done_ ||
+      !store_buffer_.GetCur().IsEmpty()) {
+    return true;
+  }
+  for (int i = 0; i < mshr_cnt_; i++) {
+    const MSHR &mshr = mshrs_[i];
+    if (mshr.busy_ && (mshr.write_cycle_ <= wc_data_.clock_->GetCycleCount() ||
+                       (rb.flush_.GetCur().flush_ && mshr.load_))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The accesses in flight are the only unit state that changes on its own, so the first of them to finish is the next
+// cycle at which an idle core can have work again.
+uint32_t Memory::GetNextEventCycle() const {
+  uint32_t cycle = (wc_inst_.IsWritePending() ? wc_inst_.GetWriteCycle() : UINT32_MAX);
+  for (int i = 0; i < mshr_cnt_; i++) {
+    if (mshrs_[i].busy_) {
+      cycle = std::min(cycle, mshrs_[i].write_cycle_);
+    }
+  }
+  return cycle;
+}
+
+const Cache &Memory::GetL1ICache() const {
+  return l1i_;
+}
+
+const Cache &Memory::GetL1DCache() const {
+  return l1d_;
+}
+
+const Cache &Memory::GetL2Cache() const {
+  return l2_;
+}
+
 void Memory::Update() {
   output_.Update();
   to_iu_.Update();
+  store_buffer_.Update();
   wc_data_.Update();
   wc_inst_.Update();
+  busy_mshr_cnt_ = std::count_if(mshrs_.begin(), mshrs_.begin() + mshr_cnt_, [](const MSHR &mshr) {
+    return mshr.busy_;
+  });
 }
 
-#ifdef _DEBUG
-void Memory::Execute(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb) {
-  if (!wc_inst_.IsBusy()) {
-    auto write_func = [this, flush = rb.flush_.GetCur().flush_, from_iu = iu.to_mem_.GetCur()]() {
-      if (flush) {
-        to_iu_.New().inst_ = 0;
-        return;
+// Pages are written in address order and only if they hold a nonzero byte, since a missing page reads as zeros.
+void Memory::Serialize(std::ostream &out) const {
+  std::vector<std::pair<uint32_t, const MemoryPage *>> pages;
+  for (uint32_t i = 0; i < page_table_.size(); i++) {
+    if (page_table_[i] == nullptr) {
+      continue;
+    }
+    for (uint32_t j = 0; j < page_table_[i]->size(); j++) {
+      const auto &page = (*page_table_[i])[j];
+      if (page != nullptr && std::any_of(page->begin(), page->end(), [](uint8_t byte) { return byte != 0; })) {
+        pages.emplace_back(i << kPageTableBits | j, page.get());
       }
-      to_iu_.New().inst_ = (from_iu.load_ ? LoadWord(from_iu.pc_) : 0);
-      to_iu_.New().pc_ = (from_iu.load_ ? from_iu.pc_ : 0);
-    };
-    wc_inst_.Set(write_func, 1);
+    }
+  }
+  WriteBinary(out, static_cast<uint32_t>(pages.size()));
+  for (const auto &page : pages) {
+    WriteBinary(out, page.first);
+    WriteBinary(out, *page.second);
   }
-  if (wc_data_.IsBusy()) {
-    if (rb.flush_.GetCur().flush_ && is_load_) {
-      wc_data_.Reset();
-      Flush();
-      is_load_ = false;
+  to_iu_.Serialize(out);
+  output_.Serialize(out);
+  store_buffer_.Serialize(out);
+  wc_data_.Serialize(out);
+  wc_inst_.Serialize(out);
+  WriteBinary(out, mshrs_);
+  WriteBinary(out, busy_mshr_cnt_);
+  WriteBinary(out, fetch_request_);
+  l2_.Serialize(out);
+  l1i_.Serialize(out);
+  l1d_.Serialize(out);
+}
+
+void Memory::Deserialize(std::istream &in) {
+  ClearPages();
+  uint32_t page_cnt = 0;
+  ReadBinary(in, page_cnt);
+  for (uint32_t i = 0; i < page_cnt && in; i++) {
+    uint32_t page_id = 0;
+    ReadBinary(in, page_id);
+    auto page = std::make_shared<MemoryPage>();
+    ReadBinary(in, *page);
+    SetPage(page_id, page);
+  }
+  to_iu_.Deserialize(in);
+  output_.Deserialize(in);
+  store_buffer_.Deserialize(in);
+  wc_data_.Deserialize(in);
+  wc_inst_.Deserialize(in);
+  ReadBinary(in, mshrs_);
+  ReadBinary(in, busy_mshr_cnt_);
+  ReadBinary(in, fetch_request_);
+  l2_.Deserialize(in);
+  l1i_.Deserialize(in);
+  l1d_.Deserialize(in);
+  BindFetchWrite();
+}
+
+#ifdef _DEBUG
+void Memory::Execute(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb) {
+  if (wc_inst_.IsBusy()) {
+    if (rb.flush_.GetCur().flush_) {
+      wc_inst_.Reset();
+      to_iu_.New() = MemoryToIU();
     }
   }
   else {
-    if (lsb.to_mem_.GetCur().load_ || rb.to_mem_.GetCur().store_) {
-      auto write_func = [this, from_lsb = lsb.to_mem_.GetCur(), from_rb = rb.to_mem_.GetCur()]() {
-        WriteOutput(from_lsb, from_rb);
-        is_load_ = false;
-      };
-      wc_data_.Set(write_func, 3);
-      is_load_ = lsb.to_mem_.GetCur().load_;
+    bool flush = rb.flush_.GetCur().flush_;
+    fetch_request_ = iu.to_mem_.GetCur();
+    int cycle_cnt = (fetch_request_.load_ && !flush && l1i_.IsEnabled() ? l1i_.Access(fetch_request_.pc_, false) : 1);
+    if (cycle_cnt > 1) {
+      to_iu_.New() = MemoryToIU();
+      to_iu_.New().stall_ = true;
     }
-    else {
-      output_.New().done_ = false;
+    wc_inst_.Set([this, flush]() { FinishFetch(flush); }, cycle_cnt);
+  }
+  if (rb.flush_.GetCur().flush_) {
+    for (auto &mshr : mshrs_) {
+      mshr.busy_ = mshr.busy_ && !mshr.load_;
     }
   }
+  StartDataAccess(rb.flush_.GetCur().flush_ ? LSBToMemory() : lsb.to_mem_.GetCur(), rb.to_mem_.GetCur());
+  wc_data_.Set([this]() { FinishDataAccess(); }, 1);
 }
 #else
 void Memory::Execute(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb) {
-  if (!wc_inst_.IsBusy()) {
-    auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
-                         RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-      if (rb.flush_.GetCur().flush_) {
-        memory.to_iu_.New().inst_ = 0;
-        return;
-      }
-      memory.to_iu_.New().inst_ = (iu.to_mem_.GetCur().load_ ? memory.LoadWord(iu.to_mem_.GetCur().pc_) : 0);
-      memory.to_iu_.New().pc_ = (iu.to_mem_.GetCur().load_ ? iu.to_mem_.GetCur().pc_ : 0);
-    };
-    wc_inst_.Set(write_func, 1);
-  }
-  if (wc_data_.IsBusy()) {
-    if (rb.flush_.GetCur().flush_ && is_load_) {
-      wc_data_.Reset();
-      Flush();
-      is_load_ = false;
+  if (wc_inst_.IsBusy()) {
+    if (rb.flush_.GetCur().flush_) {
+      wc_inst_.Reset();
+      to_iu_.New() = MemoryToIU();
     }
   }
   else {
-    if (lsb.to_mem_.GetCur().load_ || rb.to_mem_.GetCur().store_) {
-      from_lsb_ = lsb.to_mem_.GetCur();
-      from_rb_ = rb.to_mem_.GetCur();
-      auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
-                           RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-        memory.WriteOutput(memory.from_lsb_, memory.from_rb_);
-        memory.is_load_ = false;
-      };
-      wc_data_.Set(write_func, 3);
-      is_load_ = lsb.to_mem_.GetCur().load_;
+    bool flush = rb.flush_.GetCur().flush_;
+    fetch_request_ = iu.to_mem_.GetCur();
+    int cycle_cnt = (fetch_request_.load_ && !flush && l1i_.IsEnabled() ? l1i_.Access(fetch_request_.pc_, false) : 1);
+    if (cycle_cnt > 1) {
+      to_iu_.New() = MemoryToIU();
+      to_iu_.New().stall_ = true;
     }
-    else {
-      output_.New().done_ = false;
+    auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
+                         RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
+      memory.FinishFetch(rb.flush_.GetCur().flush_);
+    };
+    wc_inst_.Set(write_func, cycle_cnt);
+  }
+  if (rb.flush_.GetCur().flush_) {
+    for (auto &mshr : mshrs_) {
+      mshr.busy_ = mshr.busy_ && !mshr.load_;
     }
   }
+  StartDataAccess(rb.flush_.GetCur().flush_ ? LSBToMemory() : lsb.to_mem_.GetCur(), rb.to_mem_.GetCur());
+  auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
+                       RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
+    memory.FinishDataAccess();
+  };
+  wc_data_.Set(write_func, 1);
 }
 #endif
 
@@ -153,68 +321,164 @@ void Memory::ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadSto
 }
 #endif
 
+uint32_t Memory::FetchWord(uint32_t addr) const {
+  return Load<uint32_t>(addr, fetch_cache_);
+}
+
 uint32_t Memory::LoadWord(uint32_t addr) const {
-  return (static_cast<uint32_t>(LoadByte(addr + 3)) << 24) | (static_cast<uint32_t>(LoadByte(addr + 2)) << 16) |
-         (static_cast<uint32_t>(LoadByte(addr + 1)) << 8) | static_cast<uint32_t>(LoadByte(addr));
+  return Load<uint32_t>(addr, data_cache_);
 }
 
 uint16_t Memory::LoadHalf(uint32_t addr) const {
-  return (static_cast<uint16_t>(LoadByte(addr + 1)) << 8) | static_cast<uint16_t>(LoadByte(addr));
+  return Load<uint16_t>(addr, data_cache_);
 }
 
 uint8_t Memory::LoadByte(uint32_t addr) const {
-  if (memory_.count(addr / PageSize) == 0) {
-    return 0;
-  }
-  return memory_.at(addr / PageSize)[addr % PageSize];
+  return Load<uint8_t>(addr, data_cache_);
 }
 
 void Memory::StoreWord(uint32_t addr, uint32_t num) {
-  StoreByte(addr, static_cast<uint8_t>(GetSub(num, 7, 0)));
-  StoreByte(addr + 1, static_cast<uint8_t>(GetSub(num, 15, 8)));
-  StoreByte(addr + 2, static_cast<uint8_t>(GetSub(num, 23, 16)));
-  StoreByte(addr + 3, static_cast<uint8_t>(GetSub(num, 31, 24)));
+  Store<uint32_t>(addr, num);
 }
 
 void Memory::StoreHalf(uint32_t addr, uint16_t num) {
-  StoreByte(addr, static_cast<uint8_t>(GetSub(num, 7, 0)));
-  StoreByte(addr + 1, static_cast<uint8_t>(GetSub(num, 15, 8)));
+  Store<uint16_t>(addr, num);
 }
 
 void Memory::StoreByte(uint32_t addr, uint8_t num) {
-  memory_[addr / PageSize][addr % PageSize] = num;
+  Store<uint8_t>(addr, num);
 }
 
-void Memory::Flush() {
-  output_.New().done_ = false;
+void Memory::ClearPages() {
+  for (auto &table : page_table_) {
+    table.reset();
+  }
+  fetch_cache_ = PageCache();
+  data_cache_ = PageCache();
 }
 
-void Memory::WriteOutput(const LSBToMemory &from_lsb, const RobToMemory &from_rb) {
-  output_.New().done_ = false;
+void Memory::SetPage(uint32_t page_id, const std::shared_ptr<MemoryPage> &page) {
+  auto &table = page_table_[page_id >> kPageTableBits];
+  if (table == nullptr) {
+    table = std::make_unique<PageTable>();
+  }
+  (*table)[page_id % (1 << kPageTableBits)] = page;
+  fetch_cache_ = PageCache();
+  data_cache_ = PageCache();
+}
+
+const MemoryPage &Memory::GetPage(uint32_t addr, PageCache &cache) const {
+  uint32_t page_id = addr / kPageSize;
+  if (page_id != cache.page_id_) {
+    const auto &table = page_table_[page_id >> kPageTableBits];
+    const MemoryPage *page = (table == nullptr ? nullptr : (*table)[page_id % (1 << kPageTableBits)].get());
+    cache.page_id_ = page_id;
+    cache.page_ = (page == nullptr ? &kZeroPage : page);
+  }
+  return *cache.page_;
+}
+
+// Allocates the page if it is missing and copies it if it is still shared with an image. The page then has a new
+// address, so a port that caches it is pointed to the new one.
+MemoryPage &Memory::GetWritablePage(uint32_t addr) {
+  uint32_t page_id = addr / kPageSize;
+  auto &table = page_table_[page_id >> kPageTableBits];
+  if (table == nullptr) {
+    table = std::make_unique<PageTable>();
+  }
+  auto &page = (*table)[page_id % (1 << kPageTableBits)];
+  if (page != nullptr && page.use_count() == 1) {
+    return *page;
+  }
+  page = (page == nullptr ? std::make_shared<MemoryPage>() : std::make_shared<MemoryPage>(*page));
+  for (PageCache *cache : {&fetch_cache_, &data_cache_}) {
+    if (cache->page_id_ == page_id) {
+      cache->page_ = page.get();
+    }
+  }
+  return *page;
+}
+
+// RISC-V is little-endian, so on a little-endian host an aligned access, which never crosses a page, is a single load
+// or store of the native width. Other accesses are assembled byte by byte.
+template<class T>
+T Memory::Load(uint32_t addr, PageCache &cache) const {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (addr % sizeof(T) == 0) {
+    T num;
+    std::memcpy(&num, GetPage(addr, cache).data() + addr % kPageSize, sizeof(T));
+    return num;
+  }
+#endif
+  T num = 0;
+  for (int i = sizeof(T) - 1; i >= 0; i--) {
+    num = (num << 8) | GetPage(addr + i, cache)[(addr + i) % kPageSize];
+  }
+  return num;
+}
+
+template<class T>
+void Memory::Store(uint32_t addr, T num) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (addr % sizeof(T) == 0) {
+    std::memcpy(GetWritablePage(addr).data() + addr % kPageSize, &num, sizeof(T));
+    return;
+  }
+#endif
+  for (int i = 0; i < static_cast<int>(sizeof(T)); i++) {
+    GetWritablePage(addr + i)[(addr + i) % kPageSize] = static_cast<uint8_t>(num >> (8 * i));
+  }
+}
+
+// A load reads the memory and a store writes it as soon as the access starts, and only the result waits for the
+// latency. This is safe because a load is sent only after every older store it overlaps and a store only after every
+// older load has finished. A forwarded load already has its data and takes a single cycle. With a store buffer, a
+// committed store goes into the buffer and the oldest entry of the buffer is written instead, if a register is left
+// after the load.
+void Memory::StartDataAccess(const LSBToMemory &from_lsb, const RobToMemory &from_rb) {
+  uint32_t cycle = wc_data_.clock_->GetCycleCount();
   if (from_lsb.load_) {
-    switch (from_lsb.inst_type_) {
-      case kLB:
-        output_.New().val_ = SignExtend(LoadByte(from_lsb.load_addr_), 7);
-        break;
-      case kLH:
-        output_.New().val_ = SignExtend(LoadHalf(from_lsb.load_addr_), 15);
-        break;
-      case kLW:
-        output_.New().val_ = LoadWord(from_lsb.load_addr_);
-        break;
-      case kLBU:
-        output_.New().val_ = LoadByte(from_lsb.load_addr_);
-        break;
-      case kLHU:
-        output_.New().val_ = LoadHalf(from_lsb.load_addr_);
-        break;
-      default:
-        return;
+    MSHR &mshr = GetFreeMSHR();
+    mshr.busy_ = mshr.load_ = true;
+    mshr.output_ = MemoryOutput();
+    if (from_lsb.forwarded_) {
+      mshr.write_cycle_ = cycle;
+      mshr.output_.val_ = from_lsb.val_;
     }
-    output_.New().id_ = from_lsb.id_;
-    output_.New().done_ = true;
+    else {
+      mshr.write_cycle_ = cycle + (l1d_.IsEnabled() ? l1d_.Access(from_lsb.load_addr_, false) : latency_) - 1;
+      switch (from_lsb.inst_type_) {
+        case kLB:
+          mshr.output_.val_ = SignExtend(LoadByte(from_lsb.load_addr_), 7);
+          break;
+        case kLH:
+          mshr.output_.val_ = SignExtend(LoadHalf(from_lsb.load_addr_), 15);
+          break;
+        case kLW:
+          mshr.output_.val_ = LoadWord(from_lsb.load_addr_);
+          break;
+        case kLBU:
+          mshr.output_.val_ = LoadByte(from_lsb.load_addr_);
+          break;
+        case kLHU:
+          mshr.output_.val_ = LoadHalf(from_lsb.load_addr_);
+          break;
+        default:
+          break;
+      }
+    }
+    mshr.output_.id_ = from_lsb.id_;
+    mshr.output_.done_ = true;
+  }
+  if (store_buffer_size_ != 0) {
+    DrainStoreBuffer(from_lsb.load_);
+    if (from_rb.store_) {
+      MergeStore(from_rb);
+    }
+    return;
   }
   if (from_rb.store_) {
+    StartStoreAccess(from_rb.store_addr_);
     switch (from_rb.inst_type_) {
       case kSB:
         StoreByte(from_rb.store_addr_, GetSub(from_rb.val_, 7, 0));
@@ -226,10 +490,115 @@ void Memory::WriteOutput(const LSBToMemory &from_lsb, const RobToMemory &from_rb
         StoreWord(from_rb.store_addr_, from_rb.val_);
         break;
       default:
-        return;
+        break;
+    }
+  }
+}
+
+Memory::MSHR &Memory::GetFreeMSHR() {
+  return *std::find_if(mshrs_.begin(), mshrs_.begin() + mshr_cnt_, [](const MSHR &mshr) { return !mshr.busy_; });
+}
+
+void Memory::StartStoreAccess(uint32_t addr) {
+  MSHR &mshr = GetFreeMSHR();
+  mshr.busy_ = true;
+  mshr.load_ = false;
+  mshr.write_cycle_ = wc_data_.clock_->GetCycleCount() + (l1d_.IsEnabled() ? l1d_.Access(addr, true) : latency_) - 1;
+}
+
+// Each byte of a committed store goes into the entry of its word, which is added at the back if the buffer has none,
+// so stores to the same word are combined into a single write.
+void Memory::MergeStore(const RobToMemory &from_rb) {
+  int width = (from_rb.inst_type_ == kSB ? 1 : from_rb.inst_type_ == kSH ? 2 : 4);
+  for (int i = 0; i < width; i++) {
+    uint32_t offset = (from_rb.store_addr_ + i) % 4, addr = from_rb.store_addr_ + i - offset;
+    const auto &store_buffer = store_buffer_.GetNew();
+    int index = store_buffer.BeginId();
+    while (index != store_buffer.EndId() && store_buffer[index].addr_ != addr) {
+      index = store_buffer.Next(index);
+    }
+    if (index == store_buffer.EndId()) {
+      StoreBufferEntry entry;
+      entry.addr_ = addr;
+      store_buffer_.New().Enqueue(entry);
+    }
+    StoreBufferEntry &entry = store_buffer_.New()[index];
+    entry.val_ = (entry.val_ & ~(0xffu << 8 * offset)) | GetSub(from_rb.val_, 8 * i + 7, 8 * i) << 8 * offset;
+    entry.mask_ |= 1 << offset;
+  }
+}
+
+// The oldest entry is written to memory if a register is free after the load of this cycle.
+void Memory::DrainStoreBuffer(bool is_load_started) {
+  if (store_buffer_.GetCur().IsEmpty() || busy_mshr_cnt_ + is_load_started >= mshr_cnt_) {
+    return;
+  }
+  const StoreBufferEntry &entry = store_buffer_.GetCur().Front();
+  StartStoreAccess(entry.addr_);
+  if (entry.mask_ == 0xf) {
+    StoreWord(entry.addr_, entry.val_);
+  }
+  else {
+    for (int i = 0; i < 4; i++) {
+      if (entry.mask_ >> i & 1) {
+        StoreByte(entry.addr_ + i, GetSub(entry.val_, 8 * i + 7, 8 * i));
+      }
     }
   }
-  return;
+  store_buffer_.New().Dequeue();
 }
 
+// Every store whose latency has passed finishes, and so does the load among them that has waited longest, since the
+// output carries a single result.
+void Memory::FinishDataAccess() {
+  uint32_t cycle = wc_data_.clock_->GetCycleCount();
+  MSHR *next_load = nullptr;
+  for (int i = 0; i < mshr_cnt_; i++) {
+    MSHR &mshr = mshrs_[i];
+    if (!mshr.busy_ || mshr.write_cycle_ > cycle) {
+      continue;
+    }
+    if (!mshr.load_) {
+      mshr.busy_ = false;
+    }
+    else if (next_load == nullptr || mshr.write_cycle_ < next_load->write_cycle_) {
+      next_load = &mshr;
+    }
+  }
+  output_.New().done_ = false;
+  if (next_load != nullptr) {
+    output_.New() = next_load->output_;
+    next_load->busy_ = false;
+  }
+}
+
+// The instructions of a request are in one fetch block, so they take a single access to the L1I.
+void Memory::FinishFetch(bool flush) {
+  to_iu_.New().stall_ = false;
+  if (flush) {
+    to_iu_.New().inst_cnt_ = 0;
+    return;
+  }
+  to_iu_.New().inst_cnt_ = (fetch_request_.load_ ? fetch_request_.inst_cnt_ : 0);
+  for (int i = 0; i < to_iu_.GetNew().inst_cnt_; i++) {
+    to_iu_.New().inst_[i] = FetchWord(fetch_request_.pc_ + 4 * i);
+  }
+  to_iu_.New().pc_ = (fetch_request_.load_ ? fetch_request_.pc_ : 0);
+}
+
+// A fetch in flight across a checkpoint takes more than one cycle, and a flush before it finishes cancels it in
+// Execute(), so it never has to be flushed when it is written.
+#ifdef _DEBUG
+void Memory::BindFetchWrite() {
+  wc_inst_.Rebind([this]() { FinishFetch(false); });
+}
+#else
+void Memory::BindFetchWrite() {
+  wc_inst_.Rebind([](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
+                     RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
+    memory.FinishFetch(false);
+  });
+}
+#endif
+
 }
\ No newline at end of file
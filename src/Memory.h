@@ -4,10 +4,13 @@
 #include <array>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 #include <unordered_map>
 
+#include "utils/CircularQueue.h"
 #include "utils/Register.h"
 
+#include "Cache.h"
 #include "Clock.h"
 #include "config.h"
 #include "WriteController.h"
@@ -29,14 +32,42 @@ class ReorderBuffer;
 class ReservationStation;
 #endif
 
+constexpr int kPageSize = 4096;
+
+using MemoryPage = std::array<uint8_t, kPageSize>;
+
+/*
+ * The pages of a program by page number. A Memory initialized from an image shares its pages and copies a page before
+ * its first store to it, so one parsed program can be run by many CPUs at once, also on different threads.
+ */
+using MemoryImage = std::unordered_map<uint32_t, std::shared_ptr<MemoryPage>>;
+
 class Memory {
  public:
-  explicit Memory(const Clock &clock);
+  Memory(const Clock &clock, const Config &config);
+
+  static MemoryImage ParseImage(std::istream &in);
 
   void Debug() const;
   void Init(std::istream &in);
-  bool IsDataBusy() const;
+  void Init(const MemoryImage &image);
+  bool IsDataBusy(const LoadStoreBuffer &lsb, const ReorderBuffer &rb, bool is_load) const;
   bool IsInstReady() const;
+  int ReadStoreBuffer(uint32_t addr, int width, uint32_t &val) const;
+  bool HasWork(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb) const;
+  uint32_t GetNextEventCycle() const;
+  const Cache &GetL1ICache() const;
+  const Cache &GetL1DCache() const;
+  const Cache &GetL2Cache() const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
+  uint32_t FetchWord(uint32_t addr) const;
+  uint32_t LoadWord(uint32_t addr) const;
+  uint16_t LoadHalf(uint32_t addr) const;
+  uint8_t LoadByte(uint32_t addr) const;
+  void StoreWord(uint32_t addr, uint32_t num);
+  void StoreHalf(uint32_t addr, uint16_t num);
+  void StoreByte(uint32_t addr, uint8_t num);
   void Update();
   void Execute(const InstructionUnit &iu, const LoadStoreBuffer &lsb, const ReorderBuffer &rb);
 #ifdef _DEBUG
@@ -51,26 +82,59 @@ class Memory {
 
   Register<MemoryToIU> to_iu_;
   Register<MemoryOutput> output_;
+  // The committed stores that have not been written to memory yet, at most one entry per word.
+  Register<CircularQueue<StoreBufferEntry, kMaxStoreBufferSize>> store_buffer_;
 
  private:
-  static constexpr int PageSize = 4096;
+  static constexpr int kPageTableBits = 10;
 
-  uint32_t LoadWord(uint32_t addr) const;
-  uint16_t LoadHalf(uint32_t addr) const;
-  uint8_t LoadByte(uint32_t addr) const;
-  void StoreWord(uint32_t addr, uint32_t num);
-  void StoreHalf(uint32_t addr, uint16_t num);
-  void StoreByte(uint32_t addr, uint8_t num);
-  void Flush();
-  void WriteOutput(const LSBToMemory &from_lsb, const RobToMemory &from_rb);
+  using PageTable = std::array<std::shared_ptr<MemoryPage>, 1 << kPageTableBits>;
+
+  // The page last used by a port, so that the next access to the same page skips the page table.
+  struct PageCache {
+    uint32_t page_id_ = UINT32_MAX;
+    const MemoryPage *page_ = nullptr;
+  };
+
+  // A data access in flight. It waits in its miss status holding register until write_cycle_ and, for a load, until the
+  // output is free, so that accesses of different latencies finish out of order.
+  struct MSHR {
+    bool busy_ = false, load_ = false;
+    uint32_t write_cycle_ = 0;
+    MemoryOutput output_;
+  };
 
-  std::unordered_map<uint32_t, std::array<uint8_t, PageSize>> memory_;
+  void StartDataAccess(const LSBToMemory &from_lsb, const RobToMemory &from_rb);
+  MSHR &GetFreeMSHR();
+  void StartStoreAccess(uint32_t addr);
+  void MergeStore(const RobToMemory &from_rb);
+  void DrainStoreBuffer(bool is_load_started);
+  void FinishDataAccess();
+  void FinishFetch(bool flush);
+  void BindFetchWrite();
+  void ClearPages();
+  void SetPage(uint32_t page_id, const std::shared_ptr<MemoryPage> &page);
+  const MemoryPage &GetPage(uint32_t addr, PageCache &cache) const;
+  MemoryPage &GetWritablePage(uint32_t addr);
+  template<class T>
+  T Load(uint32_t addr, PageCache &cache) const;
+  template<class T>
+  void Store(uint32_t addr, T num);
+
+  // A two-level page table: the page numbered id is (*page_table_[id >> kPageTableBits])[id % (1 << kPageTableBits)].
+  std::array<std::unique_ptr<PageTable>, 1 << (32 - 12 - kPageTableBits)> page_table_;
+  // The instruction fetch port and the data port.
+  mutable PageCache fetch_cache_, data_cache_;
   WriteController wc_data_, wc_inst_;
-  bool is_load_;
-#ifndef _DEBUG
-  LSBToMemory from_lsb_;
-  RobToMemory from_rb_;
-#endif
+  // The number of cycles of a data access without an L1D.
+  int latency_;
+  Cache l2_, l1i_, l1d_;
+  // The data accesses in flight, in the first mshr_cnt_ entries of mshrs_, and how many of them were busy at the
+  // beginning of the cycle.
+  std::array<MSHR, kMaxMSHRCnt> mshrs_;
+  int mshr_cnt_, busy_mshr_cnt_, store_buffer_size_;
+  // The instruction fetch in flight.
+  IUToMemory fetch_request_;
 };
 
 }
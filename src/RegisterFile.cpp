@@ -7,72 +7,112 @@
 namespace bubble {
 
 RegisterFile::RegisterFile(const Clock &clock) : wc_(clock), value_(), status_() {
-  for (auto &reg_status: status_) {
-    reg_status = Register<int>(-1);
-  }
+  std::array<int, kXLen> reg_status;
+  reg_status.fill(-1);
+  status_ = Register<std::array<int, kXLen>>(reg_status);
 }
 
 void RegisterFile::Debug(const ReorderBuffer &rb) const {
   std::cout << "Register File:\n";
   std::cout << "\tid\tV\tV_r\tQ\tQ_r\t\tid\tV\tV_r\tQ\tQ_r\n";
-  auto reg_value = GetRegisterValue(rb);
-  auto reg_status = GetRegisterStatus(rb);
   for (int i = 0; i < kXLen / 2; i++) {
-    std::cout << "\t" << i << "\t" << value_[i].GetCur() << "\t" << reg_value[i] << "\t" << status_[i].GetCur() << "\t"
-              << reg_status[i] << "\t\t" << i + kXLen / 2 << "\t" << value_[i + kXLen / 2].GetCur() << "\t"
-              << reg_value[i + kXLen / 2] << "\t" << status_[i + kXLen / 2].GetCur() << "\t"
-              << reg_status[i + kXLen / 2] << "\n";
+    std::cout << "\t" << i << "\t" << value_.GetCur()[i] << "\t" << GetRegisterValue(i, rb) << "\t"
+              << status_.GetCur()[i] << "\t" << GetRegisterStatus(i, rb) << "\t\t" << i + kXLen / 2 << "\t"
+              << value_.GetCur()[i + kXLen / 2] << "\t" << GetRegisterValue(i + kXLen / 2, rb) << "\t"
+              << status_.GetCur()[i + kXLen / 2] << "\t" << GetRegisterStatus(i + kXLen / 2, rb) << "\n";
   }
   std::cout << "\n";
 }
 
-std::array<uint32_t, kXLen> RegisterFile::GetRegisterValue(const ReorderBuffer &rb) const {
-  std::array<uint32_t, kXLen> res;
-  res[0] = 0;
-  for (int i = 1; i < kXLen; i++) {
-    res[i] =
-        rb.to_rf_.GetCur().write_ && i == rb.to_rf_.GetCur().rd_ ? rb.to_rf_.GetCur().val_ : value_[i].GetCur();
-  }
-  return res;
-}
-
+// The writes of the instructions committed in the last cycle are seen at once, the last one to i winning.
 uint32_t RegisterFile::GetRegisterValue(uint8_t i, const ReorderBuffer &rb) const {
   if (i == 0) {
     return 0;
   }
-  return rb.to_rf_.GetCur().write_ && i == rb.to_rf_.GetCur().rd_ ? rb.to_rf_.GetCur().val_ : value_[i].GetCur();
-}
-
-std::array<int, kXLen> RegisterFile::GetRegisterStatus(const ReorderBuffer &rb) const {
-  std::array<int, kXLen> res;
-  res[0] = -1;
-  for (int i = 1; i < kXLen; i++) {
-    int prev_begin_id = rb.rb_.GetCur().BeginId() == 0 ? kRoBSize : rb.rb_.GetCur().BeginId() - 1;
-    res[i] = rb.to_rf_.GetCur().write_ && i == rb.to_rf_.GetCur().rd_ &&
-             prev_begin_id == status_[i].GetCur() ? -1 : status_[i].GetCur();
+  uint32_t val = value_.GetCur()[i];
+  const std::array<RobToRF, kMaxCommitWidth> &from_rb = rb.to_rf_.GetCur();
+  for (int k = 0; k < kMaxCommitWidth && from_rb[k].write_; k++) {
+    if (from_rb[k].rd_ == i) {
+      val = from_rb[k].val_;
+    }
   }
-  return res;
+  return val;
 }
 
 int RegisterFile::GetRegisterStatus(uint8_t i, const bubble::ReorderBuffer &rb) const {
   if (i == 0) {
     return -1;
   }
-  int prev_begin_id = rb.rb_.GetCur().BeginId() == 0 ? kRoBSize : rb.rb_.GetCur().BeginId() - 1;
-  return rb.to_rf_.GetCur().write_ && i == rb.to_rf_.GetCur().rd_ &&
-         prev_begin_id == status_[i].GetCur() ? -1 : status_[i].GetCur();
+  const std::array<RobToRF, kMaxCommitWidth> &from_rb = rb.to_rf_.GetCur();
+  for (int k = 0; k < kMaxCommitWidth && from_rb[k].write_; k++) {
+    if (from_rb[k].id_ == status_.GetCur()[i]) {
+      return -1;
+    }
+  }
+  return status_.GetCur()[i];
+}
+
+// The RoB id that register i waits for as an operand of the k-th instruction of the bundle, or -1 with its value in
+// val. An instruction before it in the bundle that writes i renames i first; LUI, AUIPC and JAL have their result at
+// dispatch and pass it on directly.
+int RegisterFile::ReadOperand(uint8_t i, const DispatchBundle &bundle, int k, const ReorderBuffer &rb,
+                              const ForwardingView &fwd, uint32_t &val) const {
+  for (int j = k - 1; j >= 0; j--) {
+    const DecoderOutput &producer = bundle.inst_[j];
+    if (!IsRegisterWritten(producer) || producer.rd_ != i) {
+      continue;
+    }
+    switch (producer.inst_type_) {
+      case kLUI:
+        val = producer.imm_;
+        return -1;
+      case kAUIPC:
+        val = producer.addr_ + producer.imm_;
+        return -1;
+      case kJAL:
+        val = producer.addr_ + 4;
+        return -1;
+      default:
+        return fwd.GetNewId(j);
+    }
+  }
+  int id = GetRegisterStatus(i, rb);
+  if (id == -1) {
+    val = GetRegisterValue(i, rb);
+  }
+  else if (fwd.IsReady(id)) {
+    val = fwd.GetValue(id);
+    id = -1;
+  }
+  return id;
 }
 
-void RegisterFile::Update() {
-  for (auto &reg: value_) {
-    reg.Update();
-  }
-  for (auto &reg_status: status_) {
-    reg_status.Update();
+bool RegisterFile::HasWork(const Decoder &decoder, const LoadStoreBuffer &lsb, const ReorderBuffer &rb,
+                           const ReservationStation &rs) const {
+  if (rb.flush_.GetCur().flush_ || rb.to_rf_.GetCur()[0].write_) {
+    return true;
   }
+  return decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount()) != 0;
+}
+
+void RegisterFile::Update() {
+  value_.Update();
+  status_.Update();
   wc_.Update();
 }
 
+void RegisterFile::Serialize(std::ostream &out) const {
+  value_.Serialize(out);
+  status_.Serialize(out);
+  wc_.Serialize(out);
+}
+
+void RegisterFile::Deserialize(std::istream &in) {
+  value_.Deserialize(in);
+  status_.Deserialize(in);
+  wc_.Deserialize(in);
+}
+
 #ifdef _DEBUG
 void RegisterFile::Execute(const Decoder &decoder, const LoadStoreBuffer &lsb, const ReorderBuffer &rb,
                            const ReservationStation &rs) {
@@ -80,15 +120,14 @@ void RegisterFile::Execute(const Decoder &decoder, const LoadStoreBuffer &lsb, c
     return;
   }
   auto write_func = [this, flush = rb.flush_.GetCur().flush_,
-      stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), lsb.IsFull()), from_rb = rb.to_rf_.GetCur(),
-      from_decoder = decoder.output_.GetCur(), rb_begin_id = rb.rb_.GetCur().BeginId(),
-      rb_end_id = rb.rb_.GetCur().EndId()]() {
+      dispatch_cnt = decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount()),
+      from_rb = rb.to_rf_.GetCur(), from_decoder = decoder.output_.GetCur(), rb = &rb]() {
+    RemoveDependencyAndWrite(from_rb);
     if (flush) {
       Flush();
       return;
     }
-    RemoveDependencyAndWrite(from_rb, rb_begin_id == 0 ? kRoBSize : rb_begin_id - 1);
-    AddDependency(stall, from_decoder, rb_end_id);
+    AddDependency(dispatch_cnt, from_decoder, *rb);
   };
   wc_.Set(write_func, 1);
 }
@@ -101,14 +140,13 @@ void RegisterFile::Execute(const Decoder &decoder, const LoadStoreBuffer &lsb, c
   }
   auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                                                      RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-    bool stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), lsb.IsFull());
+    int dispatch_cnt = decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount());
+    rf.RemoveDependencyAndWrite(rb.to_rf_.GetCur());
     if (rb.flush_.GetCur().flush_) {
       rf.Flush();
       return;
     }
-    int rb_begin_id = rb.rb_.GetCur().BeginId();
-    rf.RemoveDependencyAndWrite(rb.to_rf_.GetCur(), rb_begin_id == 0 ? kRoBSize : rb_begin_id - 1);
-    rf.AddDependency(stall, decoder.output_.GetCur(), rb.rb_.GetCur().EndId());
+    rf.AddDependency(dispatch_cnt, decoder.output_.GetCur(), rb);
   };
   wc_.Set(write_func, 1);
 }
@@ -137,40 +175,49 @@ void RegisterFile::ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu, L
 
 void RegisterFile::Flush() {
   for (int i = 0; i < kXLen; i++) {
-    status_[i].Write(-1);
+    if (status_.GetNew()[i] != -1) {
+      status_.New()[i] = -1;
+    }
   }
 }
 
-void RegisterFile::AddDependency(bool stall, const DecoderOutput &from_decoder, int rob_new_inst_id) {
-  if (!stall && from_decoder.get_inst_) {
-    switch (from_decoder.inst_type_) {
-      case kHALT:
-      case kBEQ:
-      case kBNE:
-      case kBLT:
-      case kBGE:
-      case kBLTU:
-      case kBGEU:
-      case kSB:
-      case kSH:
-      case kSW:
-        break;
-      default:
-        if (from_decoder.rd_ != 0) {
-          status_[from_decoder.rd_].Write(rob_new_inst_id);
-        }
-        break;
+bool RegisterFile::IsRegisterWritten(const DecoderOutput &inst) {
+  switch (inst.inst_type_) {
+    case kHALT:
+    case kBEQ:
+    case kBNE:
+    case kBLT:
+    case kBGE:
+    case kBLTU:
+    case kBGEU:
+    case kSB:
+    case kSH:
+    case kSW:
+      return false;
+    default:
+      return inst.rd_ != 0;
+  }
+}
+
+// The instructions of the bundle take the RoB ids after the last one in order, so a later one that writes the same
+// register overrides an earlier one.
+void RegisterFile::AddDependency(int dispatch_cnt, const DispatchBundle &from_decoder, const ReorderBuffer &rb) {
+  int rob_new_inst_id = rb.rb_.GetCur().EndId();
+  for (int i = 0; i < dispatch_cnt; i++) {
+    if (IsRegisterWritten(from_decoder.inst_[i])) {
+      status_.New()[from_decoder.inst_[i].rd_] = rob_new_inst_id;
     }
+    rob_new_inst_id = rb.rb_.GetCur().Next(rob_new_inst_id);
   }
 }
 
-void RegisterFile::RemoveDependencyAndWrite(const RobToRF &from_rb, int rob_commit_inst_id) {
-  if (from_rb.write_) {
-    if (from_rb.rd_ != 0) {
-      value_[from_rb.rd_].Write(from_rb.val_);
-      if (rob_commit_inst_id == status_[from_rb.rd_].GetCur()) {
-        status_[from_rb.rd_].Write(-1);
-      }
+// The writes are made in commit order even when the commit that made them also flushed, and a register only stops
+// waiting if it waited for the instruction that wrote it.
+void RegisterFile::RemoveDependencyAndWrite(const std::array<RobToRF, kMaxCommitWidth> &from_rb) {
+  for (int k = 0; k < kMaxCommitWidth && from_rb[k].write_; k++) {
+    value_.New()[from_rb[k].rd_] = from_rb[k].val_;
+    if (from_rb[k].id_ == status_.GetCur()[from_rb[k].rd_]) {
+      status_.New()[from_rb[k].rd_] = -1;
     }
   }
 }
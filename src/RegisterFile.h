@@ -28,15 +28,21 @@ class ReorderBuffer;
 class ReservationStation;
 #endif
 
+class ForwardingView;
+
 class RegisterFile {
  public:
   RegisterFile(const Clock &clock);
 
   void Debug(const ReorderBuffer &rb) const;
-  std::array<uint32_t, kXLen> GetRegisterValue(const ReorderBuffer &rb) const;
   uint32_t GetRegisterValue(uint8_t i, const ReorderBuffer &rb) const;
-  std::array<int, kXLen> GetRegisterStatus(const ReorderBuffer &rb) const;
   int GetRegisterStatus(uint8_t i, const ReorderBuffer &rb) const;
+  int ReadOperand(uint8_t i, const DispatchBundle &bundle, int k, const ReorderBuffer &rb, const ForwardingView &fwd,
+                  uint32_t &val) const;
+  bool HasWork(const Decoder &decoder, const LoadStoreBuffer &lsb, const ReorderBuffer &rb,
+               const ReservationStation &rs) const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
   void Update();
   void
   Execute(const Decoder &decoder, const LoadStoreBuffer &lsb, const ReorderBuffer &rb, const ReservationStation &rs);
@@ -50,13 +56,15 @@ class RegisterFile {
                   RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs);
 #endif
 
-  Register<uint32_t> value_[kXLen];
-  Register<int> status_[kXLen];
+  Register<std::array<uint32_t, kXLen>> value_;
+  Register<std::array<int, kXLen>> status_;
 
  private:
+  static bool IsRegisterWritten(const DecoderOutput &inst);
+
   void Flush();
-  void AddDependency(bool stall, const DecoderOutput &from_decoder, int rob_new_inst_id);
-  void RemoveDependencyAndWrite(const RobToRF &from_rb, int rob_commit_inst_id);
+  void AddDependency(int dispatch_cnt, const DispatchBundle &from_decoder, const ReorderBuffer &rb);
+  void RemoveDependencyAndWrite(const std::array<RobToRF, kMaxCommitWidth> &from_rb);
 
   WriteController wc_;
 };
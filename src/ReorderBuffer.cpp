@@ -7,65 +7,137 @@
 
 namespace bubble {
 
-ReorderBuffer::ReorderBuffer(const Clock &clock, BranchPredictor &bp) :
-    rb_(), to_rf_(), to_mem_(), flush_(), wc_(clock), bp_(&bp), halt_(false), pc_f_(), pc_with_cycle_cnt_f_() {}
+namespace {
 
-ReorderBuffer::ReorderBuffer(const Clock &clock, BranchPredictor &bp, const std::string &pc_file_name,
-                             const std::string pc_with_cycle_file_name) :
-    rb_(), to_rf_(), to_mem_(), flush_(), wc_(clock), bp_(&bp), halt_(false), pc_f_(pc_file_name), pc_with_cycle_cnt_f_(
-    pc_with_cycle_file_name) {}
+bool IsStore(InstType inst_type) {
+  return inst_type == kSB || inst_type == kSH || inst_type == kSW;
+}
+
+bool IsBranch(InstType inst_type) {
+  return inst_type == kBEQ || inst_type == kBNE || inst_type == kBLT || inst_type == kBLTU || inst_type == kBGE ||
+         inst_type == kBGEU;
+}
+
+}
+
+ForwardingView::ForwardingView(const CircularQueue<RoBEntry, kMaxRoBSize> &rb_queue, const CommonDataBus &cdb) :
+    rb_queue_(&rb_queue), cdb_(cdb) {}
+
+// The RoB id of the k-th instruction dispatched in this cycle.
+int ForwardingView::GetNewId(int k) const {
+  int id = rb_queue_->EndId();
+  for (int i = 0; i < k; i++) {
+    id = rb_queue_->Next(id);
+  }
+  return id;
+}
+
+// The number of instructions in the RoB that are older than the one at id.
+int ForwardingView::GetAge(int id) const {
+  int slot_cnt = rb_queue_->Capacity() + 1;
+  return (id - rb_queue_->BeginId() + slot_cnt) % slot_cnt;
+}
+
+InstType ForwardingView::GetInstType(int id) const {
+  return (*rb_queue_)[id].inst_type_;
+}
+
+bool ForwardingView::IsReady(int id) const {
+  uint32_t val;
+  return (*rb_queue_)[id].done_ || cdb_.Find(id, val);
+}
+
+// The result of a JALR on the bus is its target, while the value it writes is already in its RoB entry.
+uint32_t ForwardingView::GetValue(int id) const {
+  const RoBEntry &entry = (*rb_queue_)[id];
+  uint32_t val;
+  if (entry.inst_type_ != kJALR && cdb_.Find(id, val)) {
+    return val;
+  }
+  return entry.val_;
+}
+
+ReorderBuffer::ReorderBuffer(const Clock &clock, const Config &config, BranchPredictor &bp, ReturnAddressStack &ras) :
+    rb_(CircularQueue<RoBEntry, kMaxRoBSize>(config.rob_size_)), to_rf_(), to_mem_(), flush_(), halt_(false),
+    wc_(clock), commit_width_(config.commit_width_), bp_(&bp), ras_(&ras), commit_cnt_(0), predictor_updates_(),
+    predictor_update_cnt_(0), pc_f_(), pc_with_cycle_cnt_f_() {}
+
+ReorderBuffer::ReorderBuffer(const Clock &clock, const Config &config, BranchPredictor &bp, ReturnAddressStack &ras,
+                             const std::string &pc_file_name, const std::string pc_with_cycle_file_name) :
+    rb_(CircularQueue<RoBEntry, kMaxRoBSize>(config.rob_size_)), to_rf_(), to_mem_(), flush_(), halt_(false),
+    wc_(clock), commit_width_(config.commit_width_), bp_(&bp), ras_(&ras), commit_cnt_(0), predictor_updates_(),
+    predictor_update_cnt_(0), pc_f_(pc_file_name), pc_with_cycle_cnt_f_(pc_with_cycle_file_name) {}
 
 void ReorderBuffer::Debug(const Memory &memory, const ALU &alu) const {
   std::cout << "Reorder Buffer:\n";
   std::cout << "\trb_ = {\n";
-  for (int i = rb_.GetCur().BeginId(); i != rb_.GetCur().EndId(); i = (i + 1) % (kRoBSize + 1)) {
+  for (int i = rb_.GetCur().BeginId(); i != rb_.GetCur().EndId(); i = rb_.GetCur().Next(i)) {
     std::cout << "\t" << i << "\t" << rb_.GetCur()[i].ToString() << "\n";
   }
   std::cout << "\t}\n";
   std::cout << "\trb_read = {\n";
-  auto rb_queue = GetRB(memory, alu);
-  for (int i = rb_queue.BeginId(); i != rb_queue.EndId(); i = (i + 1) % (kRoBSize + 1)) {
-    std::cout << "\t" << i << "\t" << rb_queue[i].ToString() << "\n";
+  auto fwd = GetForwardingView(memory, alu);
+  for (int i = rb_.GetCur().BeginId(); i != rb_.GetCur().EndId(); i = rb_.GetCur().Next(i)) {
+    std::cout << "\t" << i << "\t{ ready = " << fwd.IsReady(i) << ", val_ = " << fwd.GetValue(i) << " }\n";
   }
   std::cout << "\t}\n";
-  std::cout << "\tto_rf_ = " << to_rf_.GetCur().ToString() << "\n";
+  for (int i = 0; i < kMaxCommitWidth && to_rf_.GetCur()[i].write_; i++) {
+    std::cout << "\tto_rf_[" << i << "] = " << to_rf_.GetCur()[i].ToString() << "\n";
+  }
   std::cout << "\tto_mem_ = " << to_mem_.GetCur().ToString() << "\n";
   std::cout << "\tflush_ = " << flush_.GetCur().ToString() << "\n\n";
 }
 
-bool ReorderBuffer::IsFull() const {
-  return rb_.GetCur().IsFull();
+int ReorderBuffer::GetFreeCount() const {
+  return rb_.GetCur().Capacity() - rb_.GetCur().Size();
 }
 
-CircularQueue<RoBEntry, kRoBSize>
-ReorderBuffer::GetRB(const Memory &memory, const ALU &alu) const {
-  CircularQueue<RoBEntry, kRoBSize> res = rb_.GetCur();
-  if (memory.output_.GetCur().done_) {
-    res[memory.output_.GetCur().id_].val_ = memory.output_.GetCur().val_;
-    res[memory.output_.GetCur().id_].done_ = true;
-  }
-  if (alu.output_.GetCur().done_) {
-    if (res[alu.output_.GetCur().id_].inst_type_ != kJALR) {
-      res[alu.output_.GetCur().id_].val_ = alu.output_.GetCur().val_;
+// Whether a store commits in this cycle as soon as the memory has room for it, that is whether the entries in front of
+// it within the commit width are all done.
+bool ReorderBuffer::IsStoreReady() const {
+  const CircularQueue<RoBEntry, kMaxRoBSize> &rb = rb_.GetCur();
+  for (int i = 0, id = rb.BeginId(); i < commit_width_ && id != rb.EndId(); i++, id = rb.Next(id)) {
+    if (!rb[id].done_ || rb[id].violated_) {
+      return false;
+    }
+    if (IsStore(rb[id].inst_type_)) {
+      return true;
     }
-    res[alu.output_.GetCur().id_].done_ = true;
   }
-  return res;
+  return false;
+}
+
+uint64_t ReorderBuffer::GetCommitCount() const {
+  return commit_cnt_;
+}
+
+ForwardingView ReorderBuffer::GetForwardingView(const Memory &memory, const ALU &alu) const {
+  return ForwardingView(rb_.GetCur(), alu.GetCommonDataBus(memory));
 }
 
-RoBEntry ReorderBuffer::GetRB(int i, const Memory &memory, const ALU &alu) const {
-  RoBEntry res = rb_.GetCur()[i];
-  if (memory.output_.GetCur().done_ && memory.output_.GetCur().id_ == i) {
-    res.val_ = memory.output_.GetCur().val_;
-    res.done_ = true;
+bool ReorderBuffer::HasWork(const ALU &alu, const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory,
+                            const ReservationStation &rs) const {
+  if (flush_.GetCur().flush_ || to_rf_.GetCur()[0].write_ || to_mem_.GetCur().store_ ||
+      alu.GetCommonDataBus(memory).HasResult()) {
+    return true;
   }
-  if (alu.output_.GetCur().done_ && alu.output_.GetCur().id_ == i) {
-    if (res.inst_type_ != kJALR) {
-      res.val_ = alu.output_.GetCur().val_;
+  if (decoder.GetDispatchCount(GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount()) != 0) {
+    return true;
+  }
+  if (!lsb.lsb_.GetCur().IsEmpty()) {
+    const LSBEntry &lsb_front = lsb.lsb_.GetCur().Front();
+    if ((lsb_front.inst_type_ == kSB || lsb_front.inst_type_ == kSH || lsb_front.inst_type_ == kSW) &&
+        lsb_front.Q1_ == -1 && lsb_front.Q2_ == -1 && !rb_.GetCur()[lsb_front.id_].done_) {
+      return true;
     }
-    res.done_ = true;
   }
-  return res;
+  if (lsb.violation_id_.GetCur() != -1 || (!rb_.GetCur().IsEmpty() && rb_.GetCur().Front().violated_)) {
+    return true;
+  }
+  if (rb_.GetCur().IsEmpty() || !rb_.GetCur().Front().done_) {
+    return false;
+  }
+  return !(IsStore(rb_.GetCur().Front().inst_type_) && memory.IsDataBusy(lsb, *this, false));
 }
 
 void ReorderBuffer::Update() {
@@ -74,6 +146,31 @@ void ReorderBuffer::Update() {
   to_mem_.Update();
   flush_.Update();
   wc_.Update();
+  UpdatePredictors();
+}
+
+void ReorderBuffer::Serialize(std::ostream &out) const {
+  rb_.Serialize(out);
+  to_rf_.Serialize(out);
+  to_mem_.Serialize(out);
+  flush_.Serialize(out);
+  wc_.Serialize(out);
+  WriteBinary(out, halt_);
+  WriteBinary(out, commit_cnt_);
+  WriteBinary(out, predictor_updates_);
+  WriteBinary(out, predictor_update_cnt_);
+}
+
+void ReorderBuffer::Deserialize(std::istream &in) {
+  rb_.Deserialize(in);
+  to_rf_.Deserialize(in);
+  to_mem_.Deserialize(in);
+  flush_.Deserialize(in);
+  wc_.Deserialize(in);
+  ReadBinary(in, halt_);
+  ReadBinary(in, commit_cnt_);
+  ReadBinary(in, predictor_updates_);
+  ReadBinary(in, predictor_update_cnt_);
 }
 
 #ifdef _DEBUG
@@ -82,38 +179,18 @@ void ReorderBuffer::Execute(const ALU &alu, const Decoder &decoder, const LoadSt
   if (wc_.IsBusy()) {
     return;
   }
-  auto write_func = [this, is_mem_busy = memory.IsDataBusy(), from_mem = memory.output_.GetCur(),
-      from_alu = alu.output_.GetCur(), from_decoder = decoder.output_.GetCur(),
-      stall = decoder.IsStallNeeded(IsFull(), rs.IsFull(), lsb.IsFull()),
-      is_lsb_empty = lsb.lsb_.GetCur().IsEmpty(), lsb_front = lsb.lsb_.GetCur().Front()]() {
+  auto write_func = [this, is_mem_busy = memory.IsDataBusy(lsb, *this, false), cdb = alu.GetCommonDataBus(memory),
+      from_decoder = decoder.output_.GetCur(),
+      dispatch_cnt = decoder.GetDispatchCount(GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount()),
+      is_lsb_empty = lsb.lsb_.GetCur().IsEmpty(), lsb_front = lsb.lsb_.GetCur().Front(),
+      violation_id = lsb.violation_id_.GetCur()]() {
     if (flush_.GetCur().flush_) {
       Flush();
       return;
     }
-    EnqueueInst(stall, from_decoder);
-    UpdateDependencies(from_mem, from_alu, is_lsb_empty, lsb_front);
-    bool is_empty = rb_.GetCur().IsEmpty();
-    const RoBEntry &rob_front = rb_.GetCur().Front();
-    bool is_front_store_inst =
-        !is_empty && (rob_front.inst_type_ == kSB || rob_front.inst_type_ == kSH || rob_front.inst_type_ == kSW);
-    bool is_front_branch_inst = !is_empty && (rob_front.inst_type_ == kBEQ || rob_front.inst_type_ == kBNE ||
-                                              rob_front.inst_type_ == kBLT || rob_front.inst_type_ == kBLTU ||
-                                              rob_front.inst_type_ == kBGE || rob_front.inst_type_ == kBGEU);
-    bool commit = !is_empty && rob_front.done_ && !(is_front_store_inst && (is_mem_busy || to_mem_.GetCur().store_));
-    WriteToRF(commit, is_front_store_inst || is_front_branch_inst, rob_front);
-    WriteToMem(commit, is_front_store_inst, rob_front);
-    if (commit) {
-      halt_ = rb_.GetCur().Front().inst_type_ == kHALT;
-      static int counter = 0;
-      pc_f_ << std::dec << counter << ": " << std::hex << rb_.New().Front().addr_ << std::endl;
-      pc_with_cycle_cnt_f_ << std::dec << counter << ": " << wc_.clock_->GetCycleCount() << std::endl;
-      counter++;
-      rb_.New().Dequeue();
-    }
-    bool flush = WriteFlush(commit, rb_.GetCur().Front());
-    if (is_front_branch_inst && commit) {
-      bp_->Update(rb_.GetCur().Front().addr_, rb_.GetCur().Front().val_, !flush);
-    }
+    EnqueueInst(dispatch_cnt, from_decoder);
+    UpdateDependencies(cdb, is_lsb_empty, lsb_front, violation_id);
+    Commit(is_mem_busy);
   };
   wc_.Set(write_func, 1);
 }
@@ -125,33 +202,15 @@ void ReorderBuffer::Execute(const ALU &alu, const Decoder &decoder, const LoadSt
   }
   auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                        RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-    bool stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), lsb.IsFull());
+    int dispatch_cnt = decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount());
     if (rb.flush_.GetCur().flush_) {
       rb.Flush();
       return;
     }
-    rb.EnqueueInst(stall, decoder.output_.GetCur());
-    rb.UpdateDependencies(memory.output_.GetCur(), alu.output_.GetCur(), lsb.lsb_.GetCur().IsEmpty(),
-                       lsb.lsb_.GetCur().Front());
-    bool is_empty = rb.rb_.GetCur().IsEmpty();
-    const RoBEntry &rob_front = rb.rb_.GetCur().Front();
-    bool is_front_store_inst =
-        !is_empty && (rob_front.inst_type_ == kSB || rob_front.inst_type_ == kSH || rob_front.inst_type_ == kSW);
-    bool is_front_branch_inst = !is_empty && (rob_front.inst_type_ == kBEQ || rob_front.inst_type_ == kBNE ||
-                                              rob_front.inst_type_ == kBLT || rob_front.inst_type_ == kBLTU ||
-                                              rob_front.inst_type_ == kBGE || rob_front.inst_type_ == kBGEU);
-    bool commit =
-        !is_empty && rob_front.done_ && !(is_front_store_inst && (memory.IsDataBusy() || rb.to_mem_.GetCur().store_));
-    rb.WriteToRF(commit, is_front_store_inst || is_front_branch_inst, rob_front);
-    rb.WriteToMem(commit, is_front_store_inst, rob_front);
-    if (commit) {
-      rb.halt_ = rb.rb_.GetCur().Front().inst_type_ == kHALT;
-      rb.rb_.New().Dequeue();
-    }
-    bool flush = rb.WriteFlush(commit, rb.rb_.GetCur().Front());
-    if (is_front_branch_inst && commit) {
-      rb.bp_->Update(rb.rb_.GetCur().Front().addr_, rb.rb_.GetCur().Front().val_, !flush);
-    }
+    rb.EnqueueInst(dispatch_cnt, decoder.output_.GetCur());
+    rb.UpdateDependencies(alu.GetCommonDataBus(memory), lsb.lsb_.GetCur().IsEmpty(), lsb.lsb_.GetCur().Front(),
+                          lsb.violation_id_.GetCur());
+    rb.Commit(memory.IsDataBusy(lsb, rb, false));
   };
   wc_.Set(write_func, 1);
 }
@@ -179,18 +238,22 @@ void ReorderBuffer::ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu,
 
 void ReorderBuffer::Flush() {
   rb_.New().Clear();
-  to_rf_.New().write_ = false;
+  to_rf_.New()[0].write_ = false;
   to_mem_.New().store_ = false;
   flush_.New().flush_ = false;
 }
 
-void ReorderBuffer::EnqueueInst(bool stall, const DecoderOutput &from_decoder) {
-  if (stall || !from_decoder.get_inst_) {
-    return;
+void ReorderBuffer::EnqueueInst(int dispatch_cnt, const DispatchBundle &from_decoder) {
+  for (int i = 0; i < dispatch_cnt; i++) {
+    EnqueueInst(from_decoder.inst_[i]);
   }
+}
+
+void ReorderBuffer::EnqueueInst(const DecoderOutput &from_decoder) {
   RoBEntry rb_entry;
   rb_entry.inst_type_ = from_decoder.inst_type_;
   rb_entry.is_jump_predicted_ = from_decoder.is_jump_predicted_;
+  rb_entry.predicted_dest_ = from_decoder.predicted_dest_;
   rb_entry.rd_ = from_decoder.rd_;
   rb_entry.addr_ = from_decoder.addr_;
   switch (from_decoder.inst_type_) {
@@ -208,6 +271,7 @@ void ReorderBuffer::EnqueueInst(bool stall, const DecoderOutput &from_decoder) {
       break;
     case kJALR:
       rb_entry.val_ = from_decoder.addr_ + 4;
+      rb_entry.is_return_ = from_decoder.rd_ == 0 && (from_decoder.rs1_ == 1 || from_decoder.rs1_ == 5);
       break;
     case kBEQ:
     case kBNE:
@@ -226,73 +290,121 @@ void ReorderBuffer::EnqueueInst(bool stall, const DecoderOutput &from_decoder) {
   rb_.New().Enqueue(rb_entry);
 }
 
-void
-ReorderBuffer::UpdateDependencies(const MemoryOutput &from_mem, const ALUOutput &from_alu, bool is_lsb_empty,
-                                  const LSBEntry &lsb_front) {
-  if (from_mem.done_) {
-    rb_.New()[from_mem.id_].val_ = from_mem.val_;
-    rb_.New()[from_mem.id_].done_ = true;
-  }
-  if (from_alu.done_) {
-    if (rb_.New()[from_alu.id_].inst_type_ == kJALR) {
-      rb_.New()[from_alu.id_].dest_ = from_alu.val_;
+void ReorderBuffer::UpdateDependencies(const CommonDataBus &cdb, bool is_lsb_empty, const LSBEntry &lsb_front,
+                                       int violation_id) {
+  cdb.ForEachResult([this](int id, uint32_t val) {
+    if (rb_.New()[id].inst_type_ == kJALR) {
+      rb_.New()[id].dest_ = val;
     }
     else {
-      rb_.New()[from_alu.id_].val_ = from_alu.val_;
+      rb_.New()[id].val_ = val;
     }
-    rb_.New()[from_alu.id_].done_ = true;
-  }
-  if (!is_lsb_empty && (lsb_front.inst_type_ == kSB || lsb_front.inst_type_ == kSH || lsb_front.inst_type_ == kSW) &&
-      lsb_front.Q1_ == -1 && lsb_front.Q2_ == -1) {
+    rb_.New()[id].done_ = true;
+  });
+  // A store committed in the last cycle is still at the front of the LSB, and its RoB entry may already be reused.
+  if (!is_lsb_empty && IsStore(lsb_front.inst_type_) && lsb_front.Q1_ == -1 && lsb_front.Q2_ == -1 &&
+      !to_mem_.GetCur().store_) {
     rb_.New()[lsb_front.id_].dest_ = lsb_front.V1_;
     rb_.New()[lsb_front.id_].val_ = lsb_front.V2_;
     rb_.New()[lsb_front.id_].done_ = true;
   }
-}
-
-void ReorderBuffer::WriteToRF(bool commit, bool is_front_branch_or_store_inst, const RoBEntry &rb_entry) {
-  if (!commit || is_front_branch_or_store_inst || rb_entry.inst_type_ == kHALT) {
-    to_rf_.New().write_ = false;
-    return;
+  if (violation_id != -1) {
+    rb_.New()[violation_id].violated_ = true;
   }
-  to_rf_.Write(RobToRF(true, rb_entry.rd_, rb_entry.val_));
 }
 
-void ReorderBuffer::WriteToMem(bool commit, bool is_front_store_inst, const RoBEntry &rb_entry) {
-  if (!(commit && is_front_store_inst)) {
-    to_mem_.New().store_ = false;
-    return;
+// The done entries at the front commit in order, up to commit_width_ of them and one store, as the memory takes one
+// store a cycle. Each register write takes a port of to_rf_, the ports in use coming first. The group ends at a jump
+// that redirects the fetch, and a HALT only commits at the front, after the writes before it have reached the register
+// file. A violated load is not committed but fetched again, with everything after it.
+void ReorderBuffer::Commit(bool is_mem_busy) {
+  const CircularQueue<RoBEntry, kMaxRoBSize> &rb = rb_.GetCur();
+  std::array<RobToRF, kMaxCommitWidth> to_rf;
+  RobToMemory to_mem;
+  FlushInfo flush_info;
+  int write_cnt = 0;
+  for (int i = 0, id = rb.BeginId(); i < commit_width_ && id != rb.EndId(); i++, id = rb.Next(id)) {
+    const RoBEntry &rb_entry = rb[id];
+    if (rb_entry.violated_) {
+      flush_info = FlushInfo(true, rb_entry.addr_);
+      break;
+    }
+    bool is_store = IsStore(rb_entry.inst_type_);
+    if (!rb_entry.done_ || (is_store && (to_mem.store_ || is_mem_busy)) || (rb_entry.inst_type_ == kHALT && i != 0)) {
+      break;
+    }
+    if (is_store) {
+      to_mem = RobToMemory(true, rb_entry.inst_type_, rb_entry.dest_, rb_entry.val_);
+    }
+    else if (!IsBranch(rb_entry.inst_type_) && rb_entry.inst_type_ != kHALT && rb_entry.rd_ != 0) {
+      to_rf[write_cnt++] = RobToRF(true, rb_entry.rd_, rb_entry.val_, id);
+    }
+    halt_ = rb_entry.inst_type_ == kHALT;
+#ifdef _DEBUG
+    pc_f_ << std::dec << commit_cnt_ << ": " << std::hex << rb_entry.addr_ << std::endl;
+    pc_with_cycle_cnt_f_ << std::dec << commit_cnt_ << ": " << wc_.clock_->GetCycleCount() << std::endl;
+#endif
+    commit_cnt_++;
+    rb_.New().Dequeue();
+    flush_info = GetFlushInfo(rb_entry);
+    if (IsBranch(rb_entry.inst_type_) || rb_entry.inst_type_ == kJAL || rb_entry.inst_type_ == kJALR) {
+      predictor_updates_[predictor_update_cnt_++] = {rb_entry, flush_info.flush_};
+    }
+    if (flush_info.flush_ || halt_) {
+      break;
+    }
   }
-  to_mem_.Write(RobToMemory(true, rb_entry.inst_type_, rb_entry.dest_, rb_entry.val_));
+  to_rf_.Write(to_rf);
+  to_mem_.Write(to_mem);
+  flush_.Write(flush_info);
 }
 
-bool ReorderBuffer::WriteFlush(bool commit, const RoBEntry &rb_entry) {
-  if (!commit) {
-    flush_.New().flush_ = false;
-    return false;
-  }
-  bool flush;
-  uint32_t dest = 0;
+// A mispredicted jump redirects the fetch to where it actually goes.
+FlushInfo ReorderBuffer::GetFlushInfo(const RoBEntry &rb_entry) const {
   switch (rb_entry.inst_type_) {
     case kJALR:
-      flush = true;
-      dest = rb_entry.dest_;
-      break;
+      return FlushInfo(!rb_entry.is_jump_predicted_ || rb_entry.predicted_dest_ != rb_entry.dest_, rb_entry.dest_);
     case kBEQ:
     case kBNE:
     case kBLT:
     case kBGE:
     case kBLTU:
     case kBGEU:
-      flush = rb_entry.is_jump_predicted_ != rb_entry.val_;
-      dest = (rb_entry.val_ ? rb_entry.dest_ : rb_entry.addr_ + 4);
-      break;
+      return FlushInfo(rb_entry.is_jump_predicted_ != rb_entry.val_,
+                       rb_entry.val_ ? rb_entry.dest_ : rb_entry.addr_ + 4);
     default:
-      flush = false;
-      break;
+      return FlushInfo();
+  }
+}
+
+// The branches and jumps committed in the last cycle train the predictors.
+void ReorderBuffer::UpdatePredictors() {
+  for (int i = 0; i < predictor_update_cnt_; i++) {
+    const PredictorUpdate &update = predictor_updates_[i];
+    if (IsBranch(update.rb_entry_.inst_type_)) {
+      bp_->Update(update.rb_entry_.addr_, update.rb_entry_.val_, !update.flush_);
+    }
+    UpdateJumpPredictors(update.rb_entry_, update.flush_);
+  }
+  predictor_update_cnt_ = 0;
+}
+
+// The committed stack of the return address stack follows the calls and returns that commit, and the BTB learns the
+// JALRs that the return address stack does not predict.
+void ReorderBuffer::UpdateJumpPredictors(const RoBEntry &rb_entry, bool flush) {
+  if (rb_entry.inst_type_ != kJAL && rb_entry.inst_type_ != kJALR) {
+    return;
+  }
+  if (rb_entry.is_return_ && ras_->IsEnabled()) {
+    ras_->CommitPop();
+    bp_->UpdateReturn(!flush);
+  }
+  else if (rb_entry.inst_type_ == kJALR) {
+    bp_->UpdateTarget(rb_entry.addr_, rb_entry.dest_, !flush);
+  }
+  if ((rb_entry.rd_ == 1 || rb_entry.rd_ == 5) && ras_->IsEnabled()) {
+    ras_->CommitPush(rb_entry.addr_ + 4);
   }
-  flush_.Write(FlushInfo(flush, dest));
-  return flush;
 }
 
 }
\ No newline at end of file
@@ -8,9 +8,11 @@
 #include "utils/CircularQueue.h"
 #include "utils/Register.h"
 
+#include "ALU.h"
 #include "BranchPredictor.h"
 #include "Clock.h"
 #include "config.h"
+#include "ReturnAddressStack.h"
 #include "WriteController.h"
 
 namespace bubble {
@@ -32,16 +34,41 @@ class ReorderBuffer;
 class ReservationStation;
 #endif
 
+/*
+ * ForwardingView is the bypass network seen by the units that capture operands: for a RoB id it tells whether the
+ * result is ready and what it is, taking this cycle's common data bus into account, without copying the RoB.
+ * It only reads the current values of registers, so it stays valid until the next Update().
+ */
+class ForwardingView {
+ public:
+  ForwardingView(const CircularQueue<RoBEntry, kMaxRoBSize> &rb_queue, const CommonDataBus &cdb);
+
+  int GetNewId(int k) const;
+  int GetAge(int id) const;
+  InstType GetInstType(int id) const;
+  bool IsReady(int id) const;
+  uint32_t GetValue(int id) const;
+
+ private:
+  const CircularQueue<RoBEntry, kMaxRoBSize> *rb_queue_;
+  CommonDataBus cdb_;
+};
+
 class ReorderBuffer {
  public:
-  ReorderBuffer(const Clock &clock, BranchPredictor &bp);
-  ReorderBuffer(const Clock &clock, BranchPredictor &bp, const std::string &pc_file_name,
-                const std::string pc_with_cycle_file_name);
+  ReorderBuffer(const Clock &clock, const Config &config, BranchPredictor &bp, ReturnAddressStack &ras);
+  ReorderBuffer(const Clock &clock, const Config &config, BranchPredictor &bp, ReturnAddressStack &ras,
+                const std::string &pc_file_name, const std::string pc_with_cycle_file_name);
 
   void Debug(const Memory &memory, const ALU &alu) const;
-  bool IsFull() const;
-  CircularQueue<RoBEntry, kRoBSize> GetRB(const Memory &memory, const ALU &alu) const;
-  RoBEntry GetRB(int i, const Memory &memory, const ALU &alu) const;
+  int GetFreeCount() const;
+  bool IsStoreReady() const;
+  uint64_t GetCommitCount() const;
+  ForwardingView GetForwardingView(const Memory &memory, const ALU &alu) const;
+  bool HasWork(const ALU &alu, const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory,
+               const ReservationStation &rs) const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
   void Update();
   void Execute(const ALU &alu, const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory,
                const ReservationStation &rs);
@@ -55,23 +82,37 @@ class ReorderBuffer {
                   RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs);
 #endif
 
-  Register<CircularQueue<RoBEntry, kRoBSize>> rb_;
-  Register<RobToRF> to_rf_;
+  Register<CircularQueue<RoBEntry, kMaxRoBSize>> rb_;
+  Register<std::array<RobToRF, kMaxCommitWidth>> to_rf_;
   Register<RobToMemory> to_mem_;
   Register<FlushInfo> flush_;
   bool halt_;
 
  private:
   void Flush();
-  void EnqueueInst(bool stall, const DecoderOutput &from_decoder);
-  void UpdateDependencies(const MemoryOutput &from_mem, const ALUOutput &from_alu, bool is_lsb_empty,
-                          const LSBEntry &lsb_front);
-  void WriteToRF(bool commit, bool is_front_branch_or_store_inst, const RoBEntry &rb_entry);
-  void WriteToMem(bool commit, bool is_front_store_inst, const RoBEntry &rb_entry);
-  bool WriteFlush(bool commit, const RoBEntry &rb_entry);
+  void EnqueueInst(int dispatch_cnt, const DispatchBundle &from_decoder);
+  void EnqueueInst(const DecoderOutput &from_decoder);
+  void UpdateDependencies(const CommonDataBus &cdb, bool is_lsb_empty, const LSBEntry &lsb_front, int violation_id);
+  void Commit(bool is_mem_busy);
+  FlushInfo GetFlushInfo(const RoBEntry &rb_entry) const;
+  void UpdatePredictors();
+  void UpdateJumpPredictors(const RoBEntry &rb_entry, bool flush);
+
+  // A branch or jump that committed, and whether it caused a flush.
+  struct PredictorUpdate {
+    RoBEntry rb_entry_;
+    bool flush_ = false;
+  };
 
   WriteController wc_;
+  int commit_width_;
   BranchPredictor *bp_;
+  ReturnAddressStack *ras_;
+  uint64_t commit_cnt_;
+  // The branches and jumps committed in this cycle. The instruction unit reads the predictors in its own write, so they
+  // are only trained in the next Update(), which keeps the timing independent of the order the units write in.
+  std::array<PredictorUpdate, kMaxCommitWidth> predictor_updates_;
+  int predictor_update_cnt_;
   std::ofstream pc_f_, pc_with_cycle_cnt_f_;
 };
 
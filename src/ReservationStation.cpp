@@ -1,3 +1,7 @@
+#include <algorithm>
+
+#include "utils/BitOperation.h"
+
 #include "ALU.h"
 #include "Decoder.h"
 #include "LoadStoreBuffer.h"
@@ -8,33 +12,168 @@
 
 namespace bubble {
 
-ReservationStation::ReservationStation(const Clock &clock) : rs_(), to_alu_(), wc_(clock) {}
+namespace {
+
+bool IsBranchUnitInst(InstType inst_type) {
+  return inst_type == kJALR || inst_type == kBEQ || inst_type == kBNE || inst_type == kBLT || inst_type == kBLTU ||
+         inst_type == kBGE || inst_type == kBGEU;
+}
+
+ALUOpType GetALUOpType(InstType inst_type) {
+  switch (inst_type) {
+    case kSUB:
+      return kSub;
+    case kAND:
+    case kANDI:
+      return kAnd;
+    case kOR:
+    case kORI:
+      return kOr;
+    case kXOR:
+    case kXORI:
+      return kXor;
+    case kSLL:
+    case kSLLI:
+      return kShiftLeftLogical;
+    case kSRL:
+    case kSRLI:
+      return kShiftRightLogical;
+    case kSRA:
+    case kSRAI:
+      return kShiftRightArithmetic;
+    case kBEQ:
+      return kEqual;
+    case kBNE:
+      return kNotEqual;
+    case kSLT:
+    case kSLTI:
+    case kBLT:
+      return kLessThan;
+    case kSLTU:
+    case kSLTIU:
+    case kBLTU:
+      return kLessThanUnsigned;
+    case kBGE:
+      return kGreaterOrEqual;
+    case kBGEU:
+      return kGreaterOrEqualUnsigned;
+    default:
+      return kAdd;
+  }
+}
+
+}
+
+ReservationStation::ReservationStation(const Clock &clock, const Config &config) :
+    to_alu_(), wc_(clock), busy_(), id_(), Q1_(), Q2_(), V1_(), V2_(), port_free_cycle_(), bus_cycle_(),
+    bus_slot_cnt_(), size_(config.rs_size_), busy_word_cnt_((config.rs_size_ + 63) / 64), alu_cnt_(config.alu_cnt_),
+    port_cnt_(config.alu_cnt_ + config.branch_unit_cnt_), alu_slot_cnt_(config.cdb_width_ - 1), port_latency_(),
+    port_pipelined_() {
+  for (int i = 0; i < port_cnt_; i++) {
+    port_latency_[i] = (i < alu_cnt_ ? config.alu_latency_ : config.branch_latency_);
+    port_pipelined_[i] = (i < alu_cnt_ ? config.alu_pipelined_ : config.branch_pipelined_);
+  }
+}
 
 void ReservationStation::Debug() const {
   std::cout << "Reservation Station:\n";
   std::cout << "\trs_ = {\n";
-  for (int i = 0; i < kRSSize; i++) {
-    std::cout << "\t" << i << "\t" << rs_.GetCur()[i].ToString() << "\n";
+  for (int i = 0; i < size_; i++) {
+    std::cout << "\t" << i << "\t" << GetEntry(i).ToString() << "\n";
   }
   std::cout << "\t}\n";
-  std::cout << "\tto_alu_ = " << to_alu_.GetCur().ToString() << "\n\n";
+  for (int i = 0; i < port_cnt_; i++) {
+    std::cout << "\tto_alu_[" << i << "] = " << to_alu_.GetCur()[i].ToString() << "\n";
+  }
+  std::cout << "\n";
+}
+
+int ReservationStation::GetFreeCount() const {
+  int busy_cnt = 0;
+  for (int word = 0; word < busy_word_cnt_; word++) {
+    busy_cnt += PopCount(busy_.GetCur()[word]);
+  }
+  return size_ - busy_cnt;
 }
 
-bool ReservationStation::IsFull() const {
-  for (int i = 0; i < kRSSize; i++) {
-    if (!rs_.GetCur()[i].busy_) {
-      return false;
+bool ReservationStation::HasWork(const ALU &alu, const Decoder &decoder, const LoadStoreBuffer &lsb,
+                                 const Memory &memory, const ReorderBuffer &rb) const {
+  if (rb.flush_.GetCur().flush_) {
+    return true;
+  }
+  for (int i = 0; i < port_cnt_; i++) {
+    if (to_alu_.GetCur()[i].execute_) {
+      return true;
+    }
+  }
+  if (decoder.output_.GetCur().rs_cnt_ != 0 &&
+      decoder.GetDispatchCount(rb.GetFreeCount(), GetFreeCount(), lsb.GetFreeCount()) != 0) {
+    return true;
+  }
+  CommonDataBus cdb = alu.GetCommonDataBus(memory);
+  for (int word = 0; word < busy_word_cnt_; word++) {
+    uint64_t busy = busy_.GetCur()[word];
+    if (busy == 0) {
+      continue;
+    }
+    if (GetReadyMask(word) != 0) {
+      return true;
+    }
+    bool is_woken = false;
+    const int *Q1 = Q1_.GetCur().data() + 64 * word, *Q2 = Q2_.GetCur().data() + 64 * word;
+    int tag_cnt = GetTagCount(word);
+    cdb.ForEachResult([busy, Q1, Q2, tag_cnt, &is_woken](int id, uint32_t val) {
+      is_woken |= ((MatchTags(Q1, id, tag_cnt) | MatchTags(Q2, id, tag_cnt)) & busy) != 0;
+    });
+    if (is_woken) {
+      return true;
     }
   }
-  return true;
+  return false;
 }
 
 void ReservationStation::Update() {
-  rs_.Update();
+  busy_.Update();
+  id_.Update();
+  Q1_.Update();
+  Q2_.Update();
+  V1_.Update();
+  V2_.Update();
   to_alu_.Update();
+  port_free_cycle_.Update();
+  bus_cycle_.Update();
+  bus_slot_cnt_.Update();
   wc_.Update();
 }
 
+void ReservationStation::Serialize(std::ostream &out) const {
+  busy_.Serialize(out);
+  id_.Serialize(out);
+  Q1_.Serialize(out);
+  Q2_.Serialize(out);
+  V1_.Serialize(out);
+  V2_.Serialize(out);
+  to_alu_.Serialize(out);
+  port_free_cycle_.Serialize(out);
+  bus_cycle_.Serialize(out);
+  bus_slot_cnt_.Serialize(out);
+  wc_.Serialize(out);
+}
+
+void ReservationStation::Deserialize(std::istream &in) {
+  busy_.Deserialize(in);
+  id_.Deserialize(in);
+  Q1_.Deserialize(in);
+  Q2_.Deserialize(in);
+  V1_.Deserialize(in);
+  V2_.Deserialize(in);
+  to_alu_.Deserialize(in);
+  port_free_cycle_.Deserialize(in);
+  bus_cycle_.Deserialize(in);
+  bus_slot_cnt_.Deserialize(in);
+  wc_.Deserialize(in);
+}
+
 #ifdef _DEBUG
 void
 ReservationStation::Execute(const ALU &alu, const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory,
@@ -42,20 +181,17 @@ ReservationStation::Execute(const ALU &alu, const Decoder &decoder, const LoadSt
   if (wc_.IsBusy()) {
     return;
   }
-  auto write_func = [this, flush = rb.flush_.GetCur().flush_, reg_value = rf.GetRegisterValue(rb),
-      reg_status = rf.GetRegisterStatus(rb), rb_queue = rb.GetRB(memory, alu), from_decoder = decoder.output_.GetCur(),
-      from_mem = memory.output_.GetCur(), from_alu = alu.output_.GetCur(),
-      stall = decoder.IsStallNeeded(rb.IsFull(), IsFull(), lsb.IsFull())]() {
+  auto write_func = [this, flush = rb.flush_.GetCur().flush_, rf = &rf, rb = &rb,
+      fwd = rb.GetForwardingView(memory, alu), from_decoder = decoder.output_.GetCur(),
+      cdb = alu.GetCommonDataBus(memory),
+      dispatch_cnt = decoder.GetDispatchCount(rb.GetFreeCount(), GetFreeCount(), lsb.GetFreeCount())]() {
     if (flush) {
       Flush();
       return;
     }
-    InsertInst(stall, from_decoder, reg_value, reg_status, rb_queue);
-    UpdateDependencies(from_mem, from_alu);
-    int rs_id = WriteToALU(rb_queue);
-    if (rs_id != -1) {
-      rs_.New()[rs_id].busy_ = false;
-    }
+    InsertInst(dispatch_cnt, from_decoder, *rf, *rb, fwd);
+    UpdateDependencies(cdb);
+    WriteToALU(fwd);
   };
   wc_.Set(write_func, 1);
 }
@@ -69,17 +205,15 @@ ReservationStation::Execute(const ALU &alu, const Decoder &decoder, const LoadSt
   }
   auto write_func = [](ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                        RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) {
-    bool stall = decoder.IsStallNeeded(rb.IsFull(), rs.IsFull(), lsb.IsFull());
+    int dispatch_cnt = decoder.GetDispatchCount(rb.GetFreeCount(), rs.GetFreeCount(), lsb.GetFreeCount());
     if (rb.flush_.GetCur().flush_) {
       rs.Flush();
       return;
     }
-    rs.InsertInst(stall, decoder.output_.GetCur(), rf, rb, memory, alu);
-    rs.UpdateDependencies(memory.output_.GetCur(), alu.output_.GetCur());
-    int rs_id = rs.WriteToALU(rb, memory, alu);
-    if (rs_id != -1) {
-      rs.rs_.New()[rs_id].busy_ = false;
-    }
+    ForwardingView fwd = rb.GetForwardingView(memory, alu);
+    rs.InsertInst(dispatch_cnt, decoder.output_.GetCur(), rf, rb, fwd);
+    rs.UpdateDependencies(alu.GetCommonDataBus(memory));
+    rs.WriteToALU(fwd);
   };
   wc_.Set(write_func, 1);
 }
@@ -109,394 +243,203 @@ ReservationStation::ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu,
 
 #endif
 
-void ReservationStation::Flush() {
-  for (int i = 0; i < kRSSize; i++) {
-    rs_.New()[i].busy_ = false;
-  }
-  to_alu_.New().execute_ = false;
+RSEntry ReservationStation::GetEntry(int i) const {
+  RSEntry entry;
+  entry.busy_ = (busy_.GetCur()[i / 64] >> (i % 64)) & 1;
+  entry.id_ = id_.GetCur()[i];
+  entry.Q1_ = Q1_.GetCur()[i];
+  entry.Q2_ = Q2_.GetCur()[i];
+  entry.V1_ = V1_.GetCur()[i];
+  entry.V2_ = V2_.GetCur()[i];
+  return entry;
 }
 
-#ifdef _DEBUG
+// The number of entries covered by busy_[word].
+int ReservationStation::GetTagCount(int word) const {
+  return std::min(64, size_ - 64 * word);
+}
 
-void ReservationStation::InsertInst(bool stall, const DecoderOutput &from_decoder,
-                                    const std::array<uint32_t, kXLen> &reg_value,
-                                    const std::array<int, kXLen> &reg_status,
-                                    const CircularQueue<RoBEntry, kRoBSize> &rb_queue) {
-  if (stall || !from_decoder.get_inst_) {
-    return;
-  }
-  bool two_op = false;
-  switch (from_decoder.inst_type_) {
-    case kLUI:
-    case kAUIPC:
-    case kJAL:
-    case kLB:
-    case kLH:
-    case kLW:
-    case kLBU:
-    case kLHU:
-    case kSB:
-    case kSH:
-    case kSW:
-    case kHALT:
-      return;
-    case kJALR:
-    case kADDI:
-    case kSLTI:
-    case kSLTIU:
-    case kXORI:
-    case kORI:
-    case kANDI:
-    case kSLLI:
-    case kSRLI:
-    case kSRAI:
-      break;
-    case kBEQ:
-    case kBNE:
-    case kBLT:
-    case kBGE:
-    case kBLTU:
-    case kBGEU:
-    case kADD:
-    case kSUB:
-    case kSLL:
-    case kSLT:
-    case kSLTU:
-    case kXOR:
-    case kSRL:
-    case kSRA:
-    case kOR:
-    case kAND:
-      two_op = true;
-      break;
-  }
-  RSEntry rs_entry;
-  rs_entry.busy_ = true;
-  rs_entry.id_ = rb_queue.EndId();
-  int rs_id;
-  for (int i = 0; i < kRSSize; i++) {
-    if (!rs_.GetCur()[i].busy_) {
-      rs_id = i;
-      break;
-    }
-  }
-  rs_entry.Q1_ = reg_status[from_decoder.rs1_];
-  if (rs_entry.Q1_ == -1) {
-    rs_entry.V1_ = reg_value[from_decoder.rs1_];
-  }
-  else {
-    if (rb_queue[rs_entry.Q1_].done_) {
-      rs_entry.V1_ = rb_queue[rs_entry.Q1_].val_;
-      rs_entry.Q1_ = -1;
-    }
-  }
-  if (two_op) {
-    rs_entry.Q2_ = reg_status[from_decoder.rs2_];
-    if (rs_entry.Q2_ == -1) {
-      rs_entry.V2_ = reg_value[from_decoder.rs2_];
-    }
-    else {
-      if (rb_queue[rs_entry.Q2_].done_) {
-        rs_entry.V2_ = rb_queue[rs_entry.Q2_].val_;
-        rs_entry.Q2_ = -1;
-      }
+// The entries covered by busy_[word] that have both operands in this cycle.
+uint64_t ReservationStation::GetReadyMask(int word) const {
+  int tag_cnt = GetTagCount(word);
+  return busy_.GetCur()[word] & MatchTags(Q1_.GetCur().data() + 64 * word, -1, tag_cnt) &
+         MatchTags(Q2_.GetCur().data() + 64 * word, -1, tag_cnt);
+}
+
+void ReservationStation::Flush() {
+  busy_.Write(std::array<uint64_t, kBusyWordCnt>());
+  for (int i = 0; i < port_cnt_; i++) {
+    if (to_alu_.GetNew()[i].execute_) {
+      to_alu_.New()[i].execute_ = false;
     }
   }
-  else {
-    rs_entry.Q2_ = -1;
-    rs_entry.V2_ = from_decoder.imm_;
-  }
-  rs_.New()[rs_id] = rs_entry;
+  // The operations in flight are flushed as well, so no port and no slot of the common data bus stays taken.
+  port_free_cycle_.Write(std::array<uint32_t, kMaxIssuePortCnt>());
+  bus_cycle_.Write(std::array<uint32_t, kMaxALULatency + 1>());
+  bus_slot_cnt_.Write(std::array<int, kMaxALULatency + 1>());
 }
 
-#else
-
-void ReservationStation::InsertInst(bool stall, const DecoderOutput &from_decoder, const RegisterFile &rf,
-                                    const ReorderBuffer &rb, const Memory &memory, const ALU &alu) {
-  if (stall || !from_decoder.get_inst_) {
+// The instructions of the bundle that go to the RS take the free entries in order, the lowest clear bits of busy_. The
+// bits past size_ are clear as well, but there are enough free entries below them.
+void ReservationStation::InsertInst(int dispatch_cnt, const DispatchBundle &from_decoder, const RegisterFile &rf,
+                                    const ReorderBuffer &rb, const ForwardingView &fwd) {
+  if (dispatch_cnt == 0 || from_decoder.rs_cnt_ == 0) {
     return;
   }
-  bool two_op = false;
-  switch (from_decoder.inst_type_) {
-    case kLUI:
-    case kAUIPC:
-    case kJAL:
-    case kLB:
-    case kLH:
-    case kLW:
-    case kLBU:
-    case kLHU:
-    case kSB:
-    case kSH:
-    case kSW:
-    case kHALT:
-      return;
-    case kJALR:
-    case kADDI:
-    case kSLTI:
-    case kSLTIU:
-    case kXORI:
-    case kORI:
-    case kANDI:
-    case kSLLI:
-    case kSRLI:
-    case kSRAI:
-      break;
-    case kBEQ:
-    case kBNE:
-    case kBLT:
-    case kBGE:
-    case kBLTU:
-    case kBGEU:
-    case kADD:
-    case kSUB:
-    case kSLL:
-    case kSLT:
-    case kSLTU:
-    case kXOR:
-    case kSRL:
-    case kSRA:
-    case kOR:
-    case kAND:
-      two_op = true;
-      break;
-  }
-  RSEntry rs_entry;
-  rs_entry.busy_ = true;
-  rs_entry.id_ = rb.rb_.GetCur().EndId();
-  int rs_id;
-  for (int i = 0; i < kRSSize; i++) {
-    if (!rs_.GetCur()[i].busy_) {
-      rs_id = i;
-      break;
+  int word = 0;
+  uint64_t free = ~busy_.GetCur()[0];
+  for (int k = 0; k < dispatch_cnt; k++) {
+    const DecoderOutput &inst = from_decoder.inst_[k];
+    bool two_op = false;
+    switch (inst.inst_type_) {
+      case kLUI:
+      case kAUIPC:
+      case kJAL:
+      case kLB:
+      case kLH:
+      case kLW:
+      case kLBU:
+      case kLHU:
+      case kSB:
+      case kSH:
+      case kSW:
+      case kHALT:
+        continue;
+      case kJALR:
+      case kADDI:
+      case kSLTI:
+      case kSLTIU:
+      case kXORI:
+      case kORI:
+      case kANDI:
+      case kSLLI:
+      case kSRLI:
+      case kSRAI:
+        break;
+      case kBEQ:
+      case kBNE:
+      case kBLT:
+      case kBGE:
+      case kBLTU:
+      case kBGEU:
+      case kADD:
+      case kSUB:
+      case kSLL:
+      case kSLT:
+      case kSLTU:
+      case kXOR:
+      case kSRL:
+      case kSRA:
+      case kOR:
+      case kAND:
+        two_op = true;
+        break;
     }
-  }
-  rs_entry.Q1_ = rf.GetRegisterStatus(from_decoder.rs1_, rb);
-  if (rs_entry.Q1_ == -1) {
-    rs_entry.V1_ = rf.GetRegisterValue(from_decoder.rs1_, rb);
-  }
-  else {
-    RoBEntry rb_Q1 = rb.GetRB(rs_entry.Q1_, memory, alu);
-    if (rb_Q1.done_) {
-      rs_entry.V1_ = rb_Q1.val_;
-      rs_entry.Q1_ = -1;
+    while (free == 0) {
+      free = ~busy_.GetCur()[++word];
     }
-  }
-  if (two_op) {
-    rs_entry.Q2_ = rf.GetRegisterStatus(from_decoder.rs2_, rb);
-    if (rs_entry.Q2_ == -1) {
-      rs_entry.V2_ = rf.GetRegisterValue(from_decoder.rs2_, rb);
+    int rs_id = 64 * word + CountTrailingZeros(free);
+    free &= free - 1;
+    busy_.New()[word] |= static_cast<uint64_t>(1) << (rs_id % 64);
+    id_.New()[rs_id] = fwd.GetNewId(k);
+    Q1_.New()[rs_id] = rf.ReadOperand(inst.rs1_, from_decoder, k, rb, fwd, V1_.New()[rs_id]);
+    if (two_op) {
+      Q2_.New()[rs_id] = rf.ReadOperand(inst.rs2_, from_decoder, k, rb, fwd, V2_.New()[rs_id]);
     }
     else {
-      RoBEntry rb_Q2 = rb.GetRB(rs_entry.Q2_, memory, alu);
-      if (rb_Q2.done_) {
-        rs_entry.V2_ = rb_Q2.val_;
-        rs_entry.Q2_ = -1;
-      }
+      Q2_.New()[rs_id] = -1;
+      V2_.New()[rs_id] = inst.imm_;
     }
   }
-  else {
-    rs_entry.Q2_ = -1;
-    rs_entry.V2_ = from_decoder.imm_;
-  }
-  rs_.New()[rs_id] = rs_entry;
 }
 
-#endif
-
-void ReservationStation::UpdateDependencies(const MemoryOutput &from_mem, const ALUOutput &from_alu) {
-  if (from_mem.done_) {
-    for (int i = 0; i < kRSSize; i++) {
-      if (rs_.New()[i].busy_) {
-        if (rs_.New()[i].Q1_ == from_mem.id_) {
-          rs_.New()[i].Q1_ = -1;
-          rs_.New()[i].V1_ = from_mem.val_;
-        }
-        if (rs_.New()[i].Q2_ == from_mem.id_) {
-          rs_.New()[i].Q2_ = -1;
-          rs_.New()[i].V2_ = from_mem.val_;
-        }
+// Each result on the bus is compared against the tags of all the entries at once.
+void ReservationStation::UpdateDependencies(const CommonDataBus &cdb) {
+  cdb.ForEachResult([this](int id, uint32_t val) {
+    for (int word = 0; word < busy_word_cnt_; word++) {
+      uint64_t busy = busy_.GetNew()[word];
+      if (busy == 0) {
+        continue;
       }
-    }
-  }
-  if (from_alu.done_) {
-    for (int i = 0; i < kRSSize; i++) {
-      if (rs_.New()[i].busy_) {
-        if (rs_.New()[i].Q1_ == from_alu.id_) {
-          rs_.New()[i].Q1_ = -1;
-          rs_.New()[i].V1_ = from_alu.val_;
-        }
-        if (rs_.New()[i].Q2_ == from_alu.id_) {
-          rs_.New()[i].Q2_ = -1;
-          rs_.New()[i].V2_ = from_alu.val_;
-        }
+      int tag_cnt = GetTagCount(word);
+      for (uint64_t match = MatchTags(Q1_.GetNew().data() + 64 * word, id, tag_cnt) & busy; match != 0;
+           match &= match - 1) {
+        int i = 64 * word + CountTrailingZeros(match);
+        Q1_.New()[i] = -1;
+        V1_.New()[i] = val;
+      }
+      for (uint64_t match = MatchTags(Q2_.GetNew().data() + 64 * word, id, tag_cnt) & busy; match != 0;
+           match &= match - 1) {
+        int i = 64 * word + CountTrailingZeros(match);
+        Q2_.New()[i] = -1;
+        V2_.New()[i] = val;
       }
     }
-  }
+  });
 }
 
-#ifdef _DEBUG
-
-int ReservationStation::WriteToALU(const CircularQueue<RoBEntry, kRoBSize> &rb_queue) {
-  to_alu_.New().execute_ = false;
-  int rs_id = -1;
-  for (int i = 0; i < kRSSize; i++) {
-    if (rs_.GetCur()[i].busy_ && rs_.GetCur()[i].Q1_ == -1 && rs_.GetCur()[i].Q2_ == -1) {
-      rs_id = i;
-      break;
+// The first port for inst_type that takes an operation in this cycle and whose result would find a slot of the common
+// data bus free. The branches go to the branch units if there are any and to the ALUs otherwise.
+int ReservationStation::SelectPort(InstType inst_type, uint32_t cycle) const {
+  bool is_branch_unit = IsBranchUnitInst(inst_type) && port_cnt_ > alu_cnt_;
+  for (int i = (is_branch_unit ? alu_cnt_ : 0); i < (is_branch_unit ? port_cnt_ : alu_cnt_); i++) {
+    uint32_t bus_cycle = cycle + 1 + port_latency_[i];
+    int k = bus_cycle % (kMaxALULatency + 1);
+    if (!to_alu_.GetNew()[i].execute_ && port_free_cycle_.GetNew()[i] <= cycle &&
+        (bus_cycle_.GetNew()[k] != bus_cycle || bus_slot_cnt_.GetNew()[k] < alu_slot_cnt_)) {
+      return i;
     }
   }
-  if (rs_id == -1) {
-    return -1;
-  }
-  RSToALU to_alu;
-  to_alu.execute_ = true;
-  to_alu.in1_ = rs_.GetCur()[rs_id].V1_;
-  to_alu.in2_ = rs_.GetCur()[rs_id].V2_;
-  to_alu.id_ = rs_.GetCur()[rs_id].id_;
-  switch (rb_queue[rs_.GetCur()[rs_id].id_].inst_type_) {
-    case kJALR:
-    case kADD:
-    case kADDI:
-      to_alu.alu_op_type_ = kAdd;
-      break;
-    case kSUB:
-      to_alu.alu_op_type_ = kSub;
-      break;
-    case kAND:
-    case kANDI:
-      to_alu.alu_op_type_ = kAnd;
-      break;
-    case kOR:
-    case kORI:
-      to_alu.alu_op_type_ = kOr;
-      break;
-    case kXOR:
-    case kXORI:
-      to_alu.alu_op_type_ = kXor;
-      break;
-    case kSLL:
-    case kSLLI:
-      to_alu.alu_op_type_ = kShiftLeftLogical;
-      break;
-    case kSRL:
-    case kSRLI:
-      to_alu.alu_op_type_ = kShiftRightLogical;
-      break;
-    case kSRA:
-    case kSRAI:
-      to_alu.alu_op_type_ = kShiftRightArithmetic;
-      break;
-    case kBEQ:
-      to_alu.alu_op_type_ = kEqual;
-      break;
-    case kBNE:
-      to_alu.alu_op_type_ = kNotEqual;
-      break;
-    case kSLT:
-    case kSLTI:
-    case kBLT:
-      to_alu.alu_op_type_ = kLessThan;
-      break;
-    case kSLTU:
-    case kSLTIU:
-    case kBLTU:
-      to_alu.alu_op_type_ = kLessThanUnsigned;
-      break;
-    case kBGE:
-      to_alu.alu_op_type_ = kGreaterOrEqual;
-      break;
-    case kBGEU:
-      to_alu.alu_op_type_ = kGreaterOrEqualUnsigned;
-      break;
-    default:
-      break;
-  }
-  to_alu_.Write(to_alu);
-  return rs_id;
+  return -1;
 }
 
-#else
-
-int ReservationStation::WriteToALU(const ReorderBuffer &rb, const Memory &memory, const ALU &alu) {
-  to_alu_.New().execute_ = false;
-  int rs_id = -1;
-  for (int i = 0; i < kRSSize; i++) {
-    if (rs_.GetCur()[i].busy_ && rs_.GetCur()[i].Q1_ == -1 && rs_.GetCur()[i].Q2_ == -1) {
-      rs_id = i;
-      break;
+// The select stage: the ready entries, oldest in the RoB first, take the ports that can start them in this cycle. The
+// entries are taken in any order as they free up, so the age comes from the RoB id rather than from the entry. An
+// operation issued now reaches its unit in the next cycle and is broadcast latency cycles after that.
+void ReservationStation::WriteToALU(const ForwardingView &fwd) {
+  for (int i = 0; i < port_cnt_; i++) {
+    if (to_alu_.GetNew()[i].execute_) {
+      to_alu_.New()[i].execute_ = false;
     }
   }
-  if (rs_id == -1) {
-    return -1;
+  // Each ready entry as its age times kMaxRSSize plus its index, so that sorting them puts the oldest first.
+  std::array<int, kMaxRSSize> ready;
+  int ready_cnt = 0;
+  for (int word = 0; word < busy_word_cnt_; word++) {
+    for (uint64_t mask = GetReadyMask(word); mask != 0; mask &= mask - 1) {
+      int i = 64 * word + CountTrailingZeros(mask);
+      ready[ready_cnt++] = fwd.GetAge(id_.GetCur()[i]) * kMaxRSSize + i;
+    }
   }
-  RSToALU to_alu;
-  to_alu.execute_ = true;
-  to_alu.in1_ = rs_.GetCur()[rs_id].V1_;
-  to_alu.in2_ = rs_.GetCur()[rs_id].V2_;
-  to_alu.id_ = rs_.GetCur()[rs_id].id_;
-  switch (rb.GetRB(rs_.GetCur()[rs_id].id_, memory, alu).inst_type_) {
-    case kJALR:
-    case kADD:
-    case kADDI:
-      to_alu.alu_op_type_ = kAdd;
-      break;
-    case kSUB:
-      to_alu.alu_op_type_ = kSub;
-      break;
-    case kAND:
-    case kANDI:
-      to_alu.alu_op_type_ = kAnd;
-      break;
-    case kOR:
-    case kORI:
-      to_alu.alu_op_type_ = kOr;
-      break;
-    case kXOR:
-    case kXORI:
-      to_alu.alu_op_type_ = kXor;
-      break;
-    case kSLL:
-    case kSLLI:
-      to_alu.alu_op_type_ = kShiftLeftLogical;
-      break;
-    case kSRL:
-    case kSRLI:
-      to_alu.alu_op_type_ = kShiftRightLogical;
-      break;
-    case kSRA:
-    case kSRAI:
-      to_alu.alu_op_type_ = kShiftRightArithmetic;
-      break;
-    case kBEQ:
-      to_alu.alu_op_type_ = kEqual;
-      break;
-    case kBNE:
-      to_alu.alu_op_type_ = kNotEqual;
-      break;
-    case kSLT:
-    case kSLTI:
-    case kBLT:
-      to_alu.alu_op_type_ = kLessThan;
-      break;
-    case kSLTU:
-    case kSLTIU:
-    case kBLTU:
-      to_alu.alu_op_type_ = kLessThanUnsigned;
-      break;
-    case kBGE:
-      to_alu.alu_op_type_ = kGreaterOrEqual;
-      break;
-    case kBGEU:
-      to_alu.alu_op_type_ = kGreaterOrEqualUnsigned;
-      break;
-    default:
-      break;
+  std::sort(ready.begin(), ready.begin() + ready_cnt);
+  uint32_t cycle = wc_.clock_->GetCycleCount();
+  int issue_cnt = 0;
+  for (int j = 0; j < ready_cnt && issue_cnt < port_cnt_; j++) {
+    int i = ready[j] % kMaxRSSize;
+    InstType inst_type = fwd.GetInstType(id_.GetCur()[i]);
+    int port = SelectPort(inst_type, cycle);
+    if (port == -1) {
+      continue;
+    }
+    RSToALU to_alu;
+    to_alu.execute_ = true;
+    to_alu.alu_op_type_ = GetALUOpType(inst_type);
+    to_alu.in1_ = V1_.GetCur()[i];
+    to_alu.in2_ = V2_.GetCur()[i];
+    to_alu.id_ = id_.GetCur()[i];
+    to_alu.latency_ = port_latency_[port];
+    to_alu_.New()[port] = to_alu;
+    port_free_cycle_.New()[port] = cycle + (port_pipelined_[port] ? 1 : port_latency_[port]);
+    uint32_t bus_cycle = cycle + 1 + port_latency_[port];
+    int k = bus_cycle % (kMaxALULatency + 1);
+    if (bus_cycle_.GetNew()[k] != bus_cycle) {
+      bus_cycle_.New()[k] = bus_cycle;
+      bus_slot_cnt_.New()[k] = 0;
+    }
+    bus_slot_cnt_.New()[k]++;
+    busy_.New()[i / 64] &= ~(static_cast<uint64_t>(1) << (i % 64));
+    issue_cnt++;
   }
-  to_alu_.Write(to_alu);
-  return rs_id;
 }
 
-#endif
-
 }
\ No newline at end of file
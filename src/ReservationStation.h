@@ -13,14 +13,18 @@ namespace bubble {
 
 #ifdef _DEBUG
 class ALU;
+class CommonDataBus;
 class Decoder;
+class ForwardingView;
 class LoadStoreBuffer;
 class Memory;
 class RegisterFile;
 class ReorderBuffer;
 #else
 class ALU;
+class CommonDataBus;
 class Decoder;
+class ForwardingView;
 class InstructionUnit;
 class LoadStoreBuffer;
 class Memory;
@@ -29,12 +33,25 @@ class ReorderBuffer;
 class ReservationStation;
 #endif
 
+/*
+ * The RS issues to alu_cnt ALU ports followed by branch_unit_cnt branch unit ports. Its select stage gives each port
+ * at most one ready entry a cycle, as long as the unit behind the port takes a new operation and one of the
+ * cdb_width - 1 slots of the common data bus left by the memory is still free in the cycle its result is broadcast.
+ * Booking the slot at issue is the arbitration of the bus: the entries older in the RoB come first and the units never
+ * wait.
+ * The entries are kept as a structure of arrays with a bitmap of the busy ones, so that a free entry is found with a
+ * bit scan and the wakeup compares the tags on the bus against a whole array of Q1_ or Q2_ at once.
+ */
 class ReservationStation {
  public:
-  ReservationStation(const Clock &clock);
+  ReservationStation(const Clock &clock, const Config &config);
 
   void Debug() const;
-  bool IsFull() const;
+  int GetFreeCount() const;
+  bool HasWork(const ALU &alu, const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory,
+               const ReorderBuffer &rb) const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
   void Update();
   void Execute(const ALU &alu, const Decoder &decoder, const LoadStoreBuffer &lsb, const Memory &memory,
                const ReorderBuffer &rb, const RegisterFile &rf);
@@ -48,26 +65,36 @@ class ReservationStation {
                   RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs);
 #endif
 
-  Register<std::array<RSEntry, kRSSize>> rs_;
-  Register<RSToALU> to_alu_;
+  Register<std::array<RSToALU, kMaxIssuePortCnt>> to_alu_;
 
  private:
+  static constexpr int kBusyWordCnt = (kMaxRSSize + 63) / 64;
+
+  RSEntry GetEntry(int i) const;
+  int GetTagCount(int word) const;
+  uint64_t GetReadyMask(int word) const;
   void Flush();
-#ifdef _DEBUG
-  void InsertInst(bool stall, const DecoderOutput &from_decoder, const std::array<uint32_t, kXLen> &reg_value,
-                  const std::array<int, kXLen> &reg_status, const CircularQueue<RoBEntry, kRoBSize> &rb_queue);
-#else
-  void InsertInst(bool stall, const DecoderOutput &from_decoder, const RegisterFile &rf, const ReorderBuffer &rb,
-                  const Memory &memory, const ALU &alu);
-#endif
-  void UpdateDependencies(const MemoryOutput &from_mem, const ALUOutput &from_alu);
-#ifdef _DEBUG
-  int WriteToALU(const CircularQueue<RoBEntry, kRoBSize> &rb_queue);
-#else
-  int WriteToALU(const ReorderBuffer &rb, const Memory &memory, const ALU &alu);
-#endif
+  void InsertInst(int dispatch_cnt, const DispatchBundle &from_decoder, const RegisterFile &rf, const ReorderBuffer &rb,
+                  const ForwardingView &fwd);
+  void UpdateDependencies(const CommonDataBus &cdb);
+  int SelectPort(InstType inst_type, uint32_t cycle) const;
+  void WriteToALU(const ForwardingView &fwd);
 
   WriteController wc_;
+  // Entry i is busy if bit i % 64 of busy_[i / 64] is set, and only the first size_ entries are used. The operand k
+  // of a busy entry waits for the result of RoB entry Qk_[i], or is Vk_[i] if Qk_[i] is -1.
+  Register<std::array<uint64_t, kBusyWordCnt>> busy_;
+  Register<std::array<int, kMaxRSSize>> id_, Q1_, Q2_;
+  Register<std::array<uint32_t, kMaxRSSize>> V1_, V2_;
+  // The first cycle in which each port takes an operation again, and the cycles in which slots of the common data bus
+  // are booked together with the number of them, each kept at its index modulo kMaxALULatency + 1.
+  Register<std::array<uint32_t, kMaxIssuePortCnt>> port_free_cycle_;
+  Register<std::array<uint32_t, kMaxALULatency + 1>> bus_cycle_;
+  Register<std::array<int, kMaxALULatency + 1>> bus_slot_cnt_;
+  int size_, busy_word_cnt_;
+  int alu_cnt_, port_cnt_, alu_slot_cnt_;
+  std::array<int, kMaxIssuePortCnt> port_latency_;
+  std::array<bool, kMaxIssuePortCnt> port_pipelined_;
 };
 
 }
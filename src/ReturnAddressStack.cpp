@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include "utils/Serialization.h"
+
+#include "ReturnAddressStack.h"
+
+namespace bubble {
+
+ReturnAddressStack::ReturnAddressStack(const Config &config) :
+    size_(config.ras_size_), stack_(), committed_stack_(), top_(0), committed_top_(0) {}
+
+bool ReturnAddressStack::IsEnabled() const {
+  return size_ != 0;
+}
+
+uint32_t ReturnAddressStack::Top() const {
+  return stack_[top_];
+}
+
+int ReturnAddressStack::GetTopIndex() const {
+  return top_;
+}
+
+// Puts back the top of the stack as GetTopIndex() and Top() gave it, which undoes the pushes and pops since then unless
+// they went below that top.
+void ReturnAddressStack::Restore(int top, uint32_t addr) {
+  top_ = top;
+  stack_[top_] = addr;
+}
+
+void ReturnAddressStack::Push(uint32_t addr) {
+  top_ = (top_ + 1) % size_;
+  stack_[top_] = addr;
+}
+
+void ReturnAddressStack::Pop() {
+  top_ = (top_ + size_ - 1) % size_;
+}
+
+void ReturnAddressStack::CommitPush(uint32_t addr) {
+  committed_top_ = (committed_top_ + 1) % size_;
+  committed_stack_[committed_top_] = addr;
+}
+
+void ReturnAddressStack::CommitPop() {
+  committed_top_ = (committed_top_ + size_ - 1) % size_;
+}
+
+void ReturnAddressStack::Flush() {
+  std::copy(committed_stack_, committed_stack_ + size_, stack_);
+  top_ = committed_top_;
+}
+
+// Only the size_ entries in use are written.
+void ReturnAddressStack::Serialize(std::ostream &out) const {
+  for (int i = 0; i < size_; i++) {
+    WriteBinary(out, stack_[i]);
+    WriteBinary(out, committed_stack_[i]);
+  }
+  WriteBinary(out, top_);
+  WriteBinary(out, committed_top_);
+}
+
+void ReturnAddressStack::Deserialize(std::istream &in) {
+  for (int i = 0; i < size_; i++) {
+    ReadBinary(in, stack_[i]);
+    ReadBinary(in, committed_stack_[i]);
+  }
+  ReadBinary(in, top_);
+  ReadBinary(in, committed_top_);
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef RISC_V_SIMULATOR_RETURNADDRESSSTACK_H
+#define RISC_V_SIMULATOR_RETURNADDRESSSTACK_H
+
+#include <cstdint>
+#include <iostream>
+
+#include "config.h"
+
+namespace bubble {
+
+/*
+ * A return address stack of config.ras_size_ entries, 0 turning it off. It is a circular buffer, so a call that finds
+ * it full drops the oldest return address. The instruction unit pushes the return address of a call and pops the
+ * predicted target of a return as they are fetched, and the RoB does the same to a second copy as they commit. Since
+ * every flush happens at the commit of the instruction that causes it, copying the committed stack back over the
+ * fetched one undoes whatever the wrong path did to it, however deep.
+ */
+class ReturnAddressStack {
+ public:
+  explicit ReturnAddressStack(const Config &config);
+
+  bool IsEnabled() const;
+  uint32_t Top() const;
+  int GetTopIndex() const;
+  void Restore(int top, uint32_t addr);
+  void Push(uint32_t addr);
+  void Pop();
+  void CommitPush(uint32_t addr);
+  void CommitPop();
+  void Flush();
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
+
+ private:
+  int size_;
+  // The top of each stack is stack_[top_].
+  uint32_t stack_[kMaxRASSize], committed_stack_[kMaxRASSize];
+  int top_, committed_top_;
+};
+
+}
+
+#endif //RISC_V_SIMULATOR_RETURNADDRESSSTACK_H
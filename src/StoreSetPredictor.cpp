@@ -0,0 +1,116 @@
+#include <algorithm>
+
+#include "utils/Serialization.h"
+
+#include "StoreSetPredictor.h"
+
+namespace bubble {
+
+StoreSetPredictor::StoreSetPredictor(const Config &config) :
+    ssit_size_(config.ssit_size_), lfst_size_(config.lfst_size_), next_store_set_(0), load_cnt_(0),
+    speculation_cnt_(0), violation_cnt_(0) {
+  std::fill(ssit_, ssit_ + kMaxSSITSize, -1);
+  std::fill(lfst_, lfst_ + kMaxLFSTSize, -1);
+}
+
+bool StoreSetPredictor::IsEnabled() const {
+  return ssit_size_ != 0;
+}
+
+// The RoB id of the store that a load at load_pc entering the LSB now has to wait for, or -1.
+int StoreSetPredictor::GetLastStore(uint32_t load_pc) const {
+  if (!IsEnabled() || ssit_[GetHash(load_pc)] == -1) {
+    return -1;
+  }
+  return lfst_[ssit_[GetHash(load_pc)]];
+}
+
+// A store enters the LSB without its address.
+void StoreSetPredictor::AddStore(uint32_t store_pc, int id) {
+  if (IsEnabled() && ssit_[GetHash(store_pc)] != -1) {
+    lfst_[ssit_[GetHash(store_pc)]] = id;
+  }
+}
+
+// The address of a store is known, so the loads of its store set can check it themselves.
+void StoreSetPredictor::ResolveStore(uint32_t store_pc, int id) {
+  if (IsEnabled() && ssit_[GetHash(store_pc)] != -1 && lfst_[ssit_[GetHash(store_pc)]] == id) {
+    lfst_[ssit_[GetHash(store_pc)]] = -1;
+  }
+}
+
+void StoreSetPredictor::Flush() {
+  std::fill(lfst_, lfst_ + lfst_size_, -1);
+}
+
+void StoreSetPredictor::CountLoad(bool speculative) {
+  speculation_cnt_ += (speculative ? 1 : 0);
+  if (++load_cnt_ % kClearInterval == 0) {
+    std::fill(ssit_, ssit_ + ssit_size_, -1);
+  }
+}
+
+// The load at load_pc read memory before the store at store_pc wrote it. Both join the store set of either, the
+// smaller one if both have one, or a new one.
+void StoreSetPredictor::Update(uint32_t load_pc, uint32_t store_pc) {
+  violation_cnt_++;
+  if (!IsEnabled()) {
+    return;
+  }
+  int &load_set = ssit_[GetHash(load_pc)], &store_set = ssit_[GetHash(store_pc)];
+  if (load_set == -1 && store_set == -1) {
+    load_set = store_set = next_store_set_;
+    next_store_set_ = (next_store_set_ + 1) % lfst_size_;
+  }
+  else if (load_set == -1 || store_set == -1) {
+    load_set = store_set = std::max(load_set, store_set);
+  }
+  else {
+    load_set = store_set = std::min(load_set, store_set);
+  }
+}
+
+uint64_t StoreSetPredictor::GetSpeculationCount() const {
+  return speculation_cnt_;
+}
+
+uint64_t StoreSetPredictor::GetViolationCount() const {
+  return violation_cnt_;
+}
+
+// The share of the loads sent ahead of a store with an unknown address that had to be replayed.
+double StoreSetPredictor::GetViolationRate() const {
+  if (speculation_cnt_ == 0) {
+    return 0;
+  }
+  return static_cast<double>(violation_cnt_) / speculation_cnt_;
+}
+
+// Only the ssit_size_ and lfst_size_ entries in use are written.
+void StoreSetPredictor::Serialize(std::ostream &out) const {
+  for (int i = 0; i < ssit_size_; i++) {
+    WriteBinary(out, ssit_[i]);
+  }
+  for (int i = 0; i < lfst_size_; i++) {
+    WriteBinary(out, lfst_[i]);
+  }
+  WriteBinary(out, next_store_set_);
+  WriteBinary(out, load_cnt_);
+  WriteBinary(out, speculation_cnt_);
+  WriteBinary(out, violation_cnt_);
+}
+
+void StoreSetPredictor::Deserialize(std::istream &in) {
+  for (int i = 0; i < ssit_size_; i++) {
+    ReadBinary(in, ssit_[i]);
+  }
+  for (int i = 0; i < lfst_size_; i++) {
+    ReadBinary(in, lfst_[i]);
+  }
+  ReadBinary(in, next_store_set_);
+  ReadBinary(in, load_cnt_);
+  ReadBinary(in, speculation_cnt_);
+  ReadBinary(in, violation_cnt_);
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef RISC_V_SIMULATOR_STORESETPREDICTOR_H
+#define RISC_V_SIMULATOR_STORESETPREDICTOR_H
+
+#include <cstdint>
+#include <iostream>
+
+#include "config.h"
+
+namespace bubble {
+
+/*
+ * A store-set memory dependence predictor. The store set id table (SSIT), indexed by the pc of a load or a store, puts
+ * the loads and stores that have aliased before into the same store set, and the last fetched store table (LFST) holds
+ * for each store set the RoB id of the youngest store in the LSB whose address is still unknown. A load waits for that
+ * store and goes ahead of every other store with an unknown address. The SSIT has config.ssit_size_ entries, a power
+ * of two, and 0 turns speculation off; the LFST has config.lfst_size_ entries. The SSIT is cleared every
+ * kClearInterval loads so that store sets do not keep growing.
+ */
+class StoreSetPredictor {
+ public:
+  explicit StoreSetPredictor(const Config &config);
+
+  bool IsEnabled() const;
+  int GetLastStore(uint32_t load_pc) const;
+  void AddStore(uint32_t store_pc, int id);
+  void ResolveStore(uint32_t store_pc, int id);
+  void Flush();
+  void CountLoad(bool speculative);
+  void Update(uint32_t load_pc, uint32_t store_pc);
+  uint64_t GetSpeculationCount() const;
+  uint64_t GetViolationCount() const;
+  double GetViolationRate() const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
+
+ private:
+  static constexpr uint64_t kClearInterval = 1 << 16;
+
+  int GetHash(uint32_t pc) const {
+    return (pc >> 2) & (ssit_size_ - 1);
+  }
+
+  int ssit_size_, lfst_size_, next_store_set_;
+  // The store set of each pc, or -1.
+  int ssit_[kMaxSSITSize];
+  // The RoB id of the last store of each store set, or -1.
+  int lfst_[kMaxLFSTSize];
+  uint64_t load_cnt_, speculation_cnt_, violation_cnt_;
+};
+
+}
+
+#endif //RISC_V_SIMULATOR_STORESETPREDICTOR_H
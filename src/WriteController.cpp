@@ -26,6 +26,29 @@ bool WriteController::IsBusy() const {
   return busy_;
 }
 
+bool WriteController::IsWritePending() const {
+  return done_.New() != INT32_MAX && clock_->GetCycleCount() < done_.New();
+}
+
+uint32_t WriteController::GetWriteCycle() const {
+  return done_.New() - 1;
+}
+
+void WriteController::Serialize(std::ostream &out) const {
+  done_.Serialize(out);
+  WriteBinary(out, busy_);
+}
+
+void WriteController::Deserialize(std::istream &in) {
+  done_.Deserialize(in);
+  ReadBinary(in, busy_);
+#ifdef _DEBUG
+  write_func_ = []() {};
+#else
+  write_func_ = nullptr;
+#endif
+}
+
 #ifdef _DEBUG
 void WriteController::Set(const std::function<void()> &write_func, int cycle_cnt) {
   if (!clock_->IsRunning() || busy_) {
@@ -35,6 +58,10 @@ void WriteController::Set(const std::function<void()> &write_func, int cycle_cnt
   write_func_ = write_func;
   busy_ = true;
 }
+
+void WriteController::Rebind(const std::function<void()> &write_func) {
+  write_func_ = write_func;
+}
 #else
 
 void WriteController::Set(
@@ -48,6 +75,12 @@ void WriteController::Set(
   busy_ = true;
 }
 
+void WriteController::Rebind(
+    void (*write_func)(ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
+                       RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs)) {
+  write_func_ = write_func;
+}
+
 #endif
 
 void WriteController::Reset() {
@@ -82,6 +115,9 @@ void WriteController::ForceWrite() const {
 #else
 void WriteController::ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                                  RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) const {
+  if (write_func_ == nullptr) {
+    return;
+  }
   write_func_(alu, decoder, iu, lsb, memory, rf, rb, rs);
 }
 #endif
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <iostream>
 #include <utility>
 
 #include "utils/Register.h"
@@ -30,6 +31,10 @@ class ReservationStation;
  * During the first cycle of each execution, use Set(write_func_, cycle_cnt_) to simulate the process that the execution
  * will last cycle_cnt_ cycles and behave like write_func_. Function write_func should capture all inputs by value.
  * At the end of each cycle, use Write() to write the output.
+ * IsWritePending() and GetWriteCycle() tell the scheduler whether, and in which cycle, the last Set() will write.
+ * Serialize() and Deserialize() save and restore the timing of the execution but not write_func_, which cannot be
+ * saved; after Deserialize(), the owner uses Rebind(write_func_) to restore the write function of an execution that is
+ * still in flight.
  */
 class WriteController {
  public:
@@ -38,13 +43,20 @@ class WriteController {
   void Update();
   bool IsReady() const;
   bool IsBusy() const;
+  bool IsWritePending() const;
+  uint32_t GetWriteCycle() const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
 #ifdef _DEBUG
   void Set(const std::function<void()> &write_func, int cycle_cnt);
+  void Rebind(const std::function<void()> &write_func);
   void Write() const;
   void ForceWrite() const;
 #else
   void Set(void (*write_func)(ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
                               RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs), int cycle_cnt);
+  void Rebind(void (*write_func)(ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
+                                 RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs));
   void Write(ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
              RegisterFile &rf, ReorderBuffer &rb, ReservationStation &rs) const;
   void ForceWrite(ALU &alu, Decoder &decoder, InstructionUnit &iu, LoadStoreBuffer &lsb, Memory &memory,
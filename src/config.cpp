@@ -1,23 +1,294 @@
+#include <algorithm>
+#include <exception>
+#include <fstream>
+
 #include "config.h"
 
 namespace bubble {
 
-InstQueueEntry::InstQueueEntry(uint32_t inst, uint32_t pc, bool jump) :
-    inst_(inst), addr_(pc), jump_(jump) {}
+bool Config::Set(const std::string &key, const std::string &value) {
+  if (key == "cache_replacement") {
+    static const std::unordered_map<std::string, ReplacementPolicy> policies = {
+        {"lru", kLRU}, {"fifo", kFIFO}, {"random", kRandom}};
+    if (policies.count(value) == 0) {
+      return false;
+    }
+    cache_replacement_ = policies.at(value);
+    return true;
+  }
+  if (key == "cache_write_policy") {
+    static const std::unordered_map<std::string, WritePolicy> policies = {
+        {"write_back", kWriteBack}, {"write_through", kWriteThrough}};
+    if (policies.count(value) == 0) {
+      return false;
+    }
+    cache_write_policy_ = policies.at(value);
+    return true;
+  }
+  if (key == "bp_type") {
+    static const std::unordered_map<std::string, BranchPredictorType> types = {
+        {"bimodal", kBimodal}, {"gshare", kGShare}, {"tournament", kTournament}, {"tage", kTAGE},
+        {"perceptron", kPerceptron}};
+    if (types.count(value) == 0) {
+      return false;
+    }
+    bp_type_ = types.at(value);
+    return true;
+  }
+  int num;
+  try {
+    std::size_t pos;
+    num = std::stoi(value, &pos);
+    if (pos != value.size()) {
+      return false;
+    }
+  }
+  catch (const std::exception &) {
+    return false;
+  }
+  if (key == "inst_queue_size") {
+    // The instruction unit keeps fetching only while 3 entries are free.
+    if (num < 4 || num > kMaxInstQueueSize) {
+      return false;
+    }
+    inst_queue_size_ = num;
+  }
+  else if (key == "ftq_size") {
+    if (num < 0 || num > kMaxFTQSize) {
+      return false;
+    }
+    ftq_size_ = num;
+  }
+  else if (key == "fetch_btb_size") {
+    if (num < 0 || num > kMaxBTBSize || (num & (num - 1)) != 0) {
+      return false;
+    }
+    fetch_btb_size_ = num;
+  }
+  else if (key == "fetch_width") {
+    if (num < 1 || num > kMaxFetchWidth || (num & (num - 1)) != 0) {
+      return false;
+    }
+    fetch_width_ = num;
+  }
+  else if (key == "dispatch_width") {
+    if (num < 1 || num > kMaxDispatchWidth) {
+      return false;
+    }
+    dispatch_width_ = num;
+  }
+  else if (key == "commit_width") {
+    if (num < 1 || num > kMaxCommitWidth) {
+      return false;
+    }
+    commit_width_ = num;
+  }
+  else if (key == "rob_size") {
+    if (num < 1 || num > kMaxRoBSize) {
+      return false;
+    }
+    rob_size_ = num;
+  }
+  else if (key == "rs_size") {
+    if (num < 1 || num > kMaxRSSize) {
+      return false;
+    }
+    rs_size_ = num;
+  }
+  else if (key == "lsb_size") {
+    if (num < 1 || num > kMaxLSBSize) {
+      return false;
+    }
+    lsb_size_ = num;
+  }
+  else if (key == "alu_cnt") {
+    if (num < 1 || num > kMaxALUCnt) {
+      return false;
+    }
+    alu_cnt_ = num;
+  }
+  else if (key == "branch_unit_cnt") {
+    if (num < 0 || num > kMaxBranchUnitCnt) {
+      return false;
+    }
+    branch_unit_cnt_ = num;
+  }
+  else if (key == "alu_latency" || key == "branch_latency") {
+    if (num < 1 || num > kMaxALULatency) {
+      return false;
+    }
+    (key == "alu_latency" ? alu_latency_ : branch_latency_) = num;
+  }
+  else if (key == "alu_pipelined" || key == "branch_pipelined") {
+    if (num != 0 && num != 1) {
+      return false;
+    }
+    (key == "alu_pipelined" ? alu_pipelined_ : branch_pipelined_) = num;
+  }
+  else if (key == "cdb_width") {
+    if (num < 2 || num > kMaxCDBWidth) {
+      return false;
+    }
+    cdb_width_ = num;
+  }
+  else if (key == "memory_latency") {
+    if (num < 1) {
+      return false;
+    }
+    memory_latency_ = num;
+  }
+  else if (key == "mshr_cnt") {
+    if (num < 1 || num > kMaxMSHRCnt) {
+      return false;
+    }
+    mshr_cnt_ = num;
+  }
+  else if (key == "bp_size") {
+    // The branch predictor indexes its table with the low bits of the pc.
+    if (num < 1 || num > kMaxBPSize || (num & (num - 1)) != 0) {
+      return false;
+    }
+    bp_size_ = num;
+  }
+  else if (key == "bp_history") {
+    if (num < 0 || num > kMaxBPHistory) {
+      return false;
+    }
+    bp_history_ = num;
+  }
+  else if (key == "ras_size") {
+    if (num < 0 || num > kMaxRASSize) {
+      return false;
+    }
+    ras_size_ = num;
+  }
+  else if (key == "btb_size" || key == "indirect_size") {
+    if (num < 0 || num > kMaxBTBSize || (num & (num - 1)) != 0) {
+      return false;
+    }
+    (key == "btb_size" ? btb_size_ : indirect_size_) = num;
+  }
+  else if (key == "ssit_size") {
+    if (num < 0 || num > kMaxSSITSize || (num & (num - 1)) != 0) {
+      return false;
+    }
+    ssit_size_ = num;
+  }
+  else if (key == "lfst_size") {
+    if (num < 1 || num > kMaxLFSTSize) {
+      return false;
+    }
+    lfst_size_ = num;
+  }
+  else if (key == "store_buffer_size") {
+    // A store that crosses a word takes two entries.
+    if (num < 0 || num == 1 || num > kMaxStoreBufferSize) {
+      return false;
+    }
+    store_buffer_size_ = num;
+  }
+  else if (key == "l1i_size" || key == "l1d_size" || key == "l2_size") {
+    if (num < 0) {
+      return false;
+    }
+    (key == "l1i_size" ? l1i_size_ : key == "l1d_size" ? l1d_size_ : l2_size_) = num;
+  }
+  else if (key == "l1i_assoc" || key == "l1d_assoc" || key == "l2_assoc") {
+    if (num < 1) {
+      return false;
+    }
+    (key == "l1i_assoc" ? l1i_assoc_ : key == "l1d_assoc" ? l1d_assoc_ : l2_assoc_) = num;
+  }
+  else if (key == "l1i_latency" || key == "l1d_latency" || key == "l2_latency") {
+    if (num < 1) {
+      return false;
+    }
+    (key == "l1i_latency" ? l1i_latency_ : key == "l1d_latency" ? l1d_latency_ : l2_latency_) = num;
+  }
+  else if (key == "line_size") {
+    // A line holds at least a whole word.
+    if (num < 4 || (num & (num - 1)) != 0) {
+      return false;
+    }
+    line_size_ = num;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+bool Config::Load(std::istream &in) {
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    auto eq = line.find('=');
+    auto trim = [](const std::string &str) {
+      auto begin = str.find_first_not_of(" \t\r");
+      auto end = str.find_last_not_of(" \t\r");
+      return begin == std::string::npos ? std::string() : str.substr(begin, end - begin + 1);
+    };
+    if (eq == std::string::npos) {
+      if (!trim(line).empty()) {
+        return false;
+      }
+      continue;
+    }
+    if (!Set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Config::ParseArgument(const std::string &arg) {
+  auto eq = arg.find('=');
+  if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+    return false;
+  }
+  std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+  if (key == "config") {
+    std::ifstream in(value);
+    return in && Load(in);
+  }
+  std::replace(key.begin(), key.end(), '-', '_');
+  return Set(key, value);
+}
 
-IUToMemory::IUToMemory(bool load, uint32_t pc) : load_(load), pc_(pc) {}
+std::string Config::ToString() const {
+  std::stringstream sstr;
+  sstr << "{ inst_queue_size_ = " << inst_queue_size_ << ", ftq_size_ = " << ftq_size_ << ", fetch_btb_size_ = "
+       << fetch_btb_size_ << ", fetch_width_ = " << fetch_width_ << ", dispatch_width_ = " << dispatch_width_
+       << ", commit_width_ = " << commit_width_ << ", rob_size_ = " << rob_size_ << ", rs_size_ = " << rs_size_
+       << ", lsb_size_ = " << lsb_size_ << ", alu_cnt_ = " << alu_cnt_ << ", alu_latency_ = " << alu_latency_
+       << ", alu_pipelined_ = " << alu_pipelined_ << ", branch_unit_cnt_ = " << branch_unit_cnt_
+       << ", branch_latency_ = " << branch_latency_ << ", branch_pipelined_ = " << branch_pipelined_
+       << ", cdb_width_ = " << cdb_width_ << ", memory_latency_ = " << memory_latency_ << ", mshr_cnt_ = " << mshr_cnt_
+       << ", bp_size_ = " << bp_size_ << ", bp_history_ = " << bp_history_ << ", btb_size_ = " << btb_size_
+       << ", indirect_size_ = " << indirect_size_ << ", ras_size_ = " << ras_size_ << ", ssit_size_ = " << ssit_size_
+       << ", lfst_size_ = " << lfst_size_ << ", store_buffer_size_ = " << store_buffer_size_ << ", l1i_size_ = "
+       << l1i_size_ << ", l1i_assoc_ = " << l1i_assoc_ << ", l1i_latency_ = " << l1i_latency_ << ", l1d_size_ = "
+       << l1d_size_ << ", l1d_assoc_ = " << l1d_assoc_ << ", l1d_latency_ = " << l1d_latency_ << ", l2_size_ = "
+       << l2_size_ << ", l2_assoc_ = " << l2_assoc_ << ", l2_latency_ = " << l2_latency_ << ", line_size_ = "
+       << line_size_ << ", cache_replacement_ = " << cache_replacement_ << ", cache_write_policy_ = "
+       << cache_write_policy_ << ", bp_type_ = " << bp_type_ << " }";
+  return sstr.str();
+}
 
-IUToDecoder::IUToDecoder(bool get_inst, uint32_t inst, uint32_t pc, bool jump) :
-    get_inst_(get_inst), inst_(inst), addr_(pc), is_jump_predicted_(jump) {}
+InstQueueEntry::InstQueueEntry(uint32_t inst, uint32_t pc, bool jump, uint32_t predicted_dest) :
+    inst_(inst), addr_(pc), predicted_dest_(predicted_dest), jump_(jump) {}
 
-RobToRF::RobToRF(bool write, uint8_t rd, uint32_t val) :
-    write_(write), rd_(rd), val_(val) {}
+IUToMemory::IUToMemory(bool load, uint32_t pc, int inst_cnt) : load_(load), pc_(pc), inst_cnt_(inst_cnt) {}
+
+IUToDecoder::IUToDecoder(bool get_inst, uint32_t inst, uint32_t pc, bool jump, uint32_t predicted_dest) :
+    get_inst_(get_inst), is_jump_predicted_(jump), inst_(inst), addr_(pc), predicted_dest_(predicted_dest) {}
+
+RobToRF::RobToRF(bool write, uint8_t rd, uint32_t val, int id) :
+    write_(write), rd_(rd), val_(val), id_(id) {}
 
 RobToMemory::RobToMemory(bool store, InstType inst_type, uint32_t addr, uint32_t val) :
     store_(store), inst_type_(inst_type), store_addr_(addr), val_(val) {}
 
 FlushInfo::FlushInfo(bool flush, uint32_t pc) : flush_(flush), pc_(pc) {}
 
-MemoryToIU::MemoryToIU(uint32_t inst, uint32_t pc) : inst_(inst), pc_(pc) {}
-
 }
\ No newline at end of file
@@ -13,17 +13,121 @@ namespace bubble {
 
 constexpr int kXLen = 32;
 
-#ifdef _DEBUG
-constexpr int kInstQueueSize = 16;
-constexpr int kRoBSize = 32;
-constexpr int kRSSize = 16;
-constexpr int kLSBSize = 16;
-#else
-constexpr int kInstQueueSize = 16;
-constexpr int kRoBSize = 32;
-constexpr int kRSSize = 16;
-constexpr int kLSBSize = 16;
-#endif
+// Upper bounds of the buffer sizes in Config. The buffers are allocated with these capacities and only the first
+// Config entries are used.
+constexpr int kMaxFTQSize = 64;
+constexpr int kMaxFetchWidth = 8;
+constexpr int kMaxDispatchWidth = 8;
+constexpr int kMaxCommitWidth = 8;
+constexpr int kMaxInstQueueSize = 64;
+constexpr int kMaxRoBSize = 256;
+constexpr int kMaxRSSize = 128;
+constexpr int kMaxLSBSize = 64;
+constexpr int kMaxALUCnt = 4;
+constexpr int kMaxBranchUnitCnt = 4;
+constexpr int kMaxIssuePortCnt = kMaxALUCnt + kMaxBranchUnitCnt;
+constexpr int kMaxALULatency = 16;
+constexpr int kMaxCDBWidth = kMaxIssuePortCnt + 1;
+constexpr int kMaxBPSize = 4096;
+constexpr int kMaxBPHistory = 64;
+constexpr int kMaxBTBSize = 4096;
+constexpr int kMaxRASSize = 64;
+constexpr int kMaxMSHRCnt = 16;
+constexpr int kMaxSSITSize = 4096;
+constexpr int kMaxLFSTSize = 256;
+constexpr int kMaxStoreBufferSize = 64;
+
+enum ReplacementPolicy {
+  kLRU, kFIFO, kRandom
+};
+
+enum WritePolicy {
+  kWriteBack, kWriteThrough
+};
+
+enum BranchPredictorType {
+  kBimodal, kGShare, kTournament, kTAGE, kPerceptron
+};
+
+/*
+ * Microarchitecture parameters chosen at runtime. Set(key, value) sets one of them by the name of its field without the
+ * trailing underscore (e.g. rob_size) and Load(in) reads "key = value" lines, where # starts a comment.
+ * ParseArgument(arg) accepts the command line forms --config=path and --rob-size=n etc. All of them return false on an
+ * unknown key or a value out of range.
+ * A cache of size 0 is left out. Without an L1D every data access takes memory_latency cycles and without an L1I every
+ * fetch takes 1 cycle; otherwise memory_latency is the latency of the memory behind the last cache level. Sizes are in
+ * bytes and cache_replacement is lru, fifo or random, cache_write_policy write_back (with write allocate) or
+ * write_through (without).
+ * bp_type is bimodal, gshare, tournament, tage or perceptron, the conditional branch predictor; bp_size is the number
+ * of entries of each of its tables, a power of two, and bp_history the number of global history bits it uses.
+ * ftq_size is the number of fetch targets the instruction unit predicts ahead of fetch, looking up the fetch pc in a
+ * fetch BTB of fetch_btb_size entries (a power of two), so that a predicted jump costs no fetch bubble; with ftq_size 0
+ * the target of a jump is only known once the jump is fetched.
+ * fetch_width, a power of two, is the number of instructions the memory delivers in a cycle, from an aligned block of
+ * fetch_width words that does not cross an L1I line and ends after a predicted jump. With ftq_size 0 it is 1.
+ * dispatch_width is the number of instructions decoded and dispatched to the RoB, the RS and the LSB in a cycle.
+ * commit_width is the number of instructions the RoB commits in a cycle, of which at most one store.
+ * alu_cnt simple ALUs and branch_unit_cnt branch units, which execute the conditional branches and JALR, are the issue
+ * ports of the RS, each taking one operation a cycle; with branch_unit_cnt 0 the ALUs execute the branches as well.
+ * alu_latency and branch_latency are their latencies in cycles, and with alu_pipelined (branch_pipelined) 0 a unit
+ * takes no new operation until the last one is done.
+ * cdb_width is the number of results broadcast on the common data bus in a cycle. One slot belongs to the memory and
+ * the other cdb_width - 1 to the issue ports; the RS only issues an operation whose result will find a slot free.
+ * btb_size and indirect_size are the entries of the branch target buffer and of the indirect target predictor that
+ * predict the target of JALR, powers of two; with btb_size 0 every JALR waits for its commit. ras_size is the depth of
+ * the return address stack that predicts the target of a return instead, and 0 leaves returns to the BTB.
+ * mshr_cnt is the number of data accesses the memory keeps in flight at once; with 1 the data port is blocking.
+ * ssit_size and lfst_size are the table sizes of the store-set predictor; ssit_size 0 keeps every load behind the older
+ * stores with unknown addresses.
+ * store_buffer_size is the number of words of committed stores waiting to be written to memory; with 0 a store is
+ * written as it commits and the commit waits for the data port.
+ */
+struct Config {
+  int inst_queue_size_ = 16;
+  int ftq_size_ = 8;
+  int fetch_btb_size_ = 256;
+  int fetch_width_ = 4;
+  int dispatch_width_ = 4;
+  int commit_width_ = 4;
+  int rob_size_ = 32;
+  int rs_size_ = 16;
+  int lsb_size_ = 16;
+  int alu_cnt_ = 2;
+  int alu_latency_ = 1;
+  bool alu_pipelined_ = true;
+  int branch_unit_cnt_ = 1;
+  int branch_latency_ = 1;
+  bool branch_pipelined_ = true;
+  int cdb_width_ = 4;
+  int memory_latency_ = 3;
+  int mshr_cnt_ = 1;
+  int bp_size_ = 128;
+  int bp_history_ = 32;
+  int btb_size_ = 64;
+  int indirect_size_ = 64;
+  int ras_size_ = 16;
+  int ssit_size_ = 1024;
+  int lfst_size_ = 128;
+  int store_buffer_size_ = 8;
+  int l1i_size_ = 0;
+  int l1i_assoc_ = 2;
+  int l1i_latency_ = 1;
+  int l1d_size_ = 0;
+  int l1d_assoc_ = 4;
+  int l1d_latency_ = 3;
+  int l2_size_ = 0;
+  int l2_assoc_ = 8;
+  int l2_latency_ = 10;
+  int line_size_ = 64;
+  ReplacementPolicy cache_replacement_ = kLRU;
+  WritePolicy cache_write_policy_ = kWriteBack;
+  BranchPredictorType bp_type_ = kTAGE;
+
+  bool Set(const std::string &key, const std::string &value);
+  bool Load(std::istream &in);
+  bool ParseArgument(const std::string &arg);
+  std::string ToString() const;
+};
 
 enum InstType {
   kLUI, kAUIPC, kJAL, kJALR, kBEQ, kBNE, kBLT, kBGE, kBLTU, kBGEU, kLB, kLH, kLW, kLBU, kLHU, kSB, kSH, kSW, kADDI,
@@ -90,51 +194,74 @@ const std::unordered_map<ALUOpType, std::string> alu_map = {{kAdd,
                                                             {kGreaterOrEqual,         "kGreaterOrEqual"},
                                                             {kGreaterOrEqualUnsigned, "kGreaterOrEqualUnsigned"}};
 
+// predicted_dest_ is the address fetched after a jump predicted to be taken.
 struct InstQueueEntry {
-  uint32_t inst_ = 0, addr_ = 0;
+  uint32_t inst_ = 0, addr_ = 0, predicted_dest_ = 0;
   bool jump_ = false;
 
   InstQueueEntry() = default;
-  InstQueueEntry(uint32_t inst, uint32_t pc, bool jump);
+  InstQueueEntry(uint32_t inst, uint32_t pc, bool jump, uint32_t predicted_dest);
   InstQueueEntry &operator=(const InstQueueEntry &other) = default;
 
   std::string ToString() const {
     std::stringstream sstr;
     sstr << std::boolalpha;
-    sstr << "{ inst_ = " << inst_ << ", addr_ = " << addr_ << ", jump_ = " << jump_ << " }";
+    sstr << "{ inst_ = " << inst_ << ", addr_ = " << addr_ << ", jump_ = " << jump_ << ", predicted_dest_ = "
+         << predicted_dest_ << " }";
+    return sstr.str();
+  }
+};
+
+// A fetch address predicted by the instruction unit. inst_ is the control transfer instruction the fetch BTB holds for
+// pc_, or 0, and jump_ and target_ what was predicted from it; history_, path_history_, ras_top_ and ras_addr_ are the
+// speculative branch and path histories and the top of the return address stack before that prediction, to undo it
+// if inst_ is wrong.
+struct FetchTarget {
+  uint32_t pc_ = 0, inst_ = 0, target_ = 0, ras_addr_ = 0, path_history_ = 0;
+  uint64_t history_ = 0;
+  int ras_top_ = 0;
+  bool jump_ = false, fetched_ = false;
+
+  std::string ToString() const {
+    std::stringstream sstr;
+    sstr << std::boolalpha;
+    sstr << "{ pc_ = " << pc_ << ", inst_ = " << inst_ << ", jump_ = " << jump_ << ", target_ = " << target_
+         << ", fetched_ = " << fetched_ << " }";
     return sstr.str();
   }
 };
 
+// A request to fetch inst_cnt_ instructions from pc_ on, which never cross a fetch block.
 struct IUToMemory {
   bool load_ = false;
   uint32_t pc_ = 0;
+  int inst_cnt_ = 0;
 
   IUToMemory() = default;
-  IUToMemory(bool load, uint32_t pc);
+  IUToMemory(bool load, uint32_t pc, int inst_cnt);
   IUToMemory &operator=(const IUToMemory &other) = default;
 
   std::string ToString() const {
     std::stringstream sstr;
     sstr << std::boolalpha;
-    sstr << "{ load_ = " << load_ << ", pc_ = " << pc_ << " }";
+    sstr << "{ load_ = " << load_ << ", pc_ = " << pc_ << ", inst_cnt_ = " << inst_cnt_ << " }";
     return sstr.str();
   }
 };
 
 struct IUToDecoder {
   bool get_inst_ = false, is_jump_predicted_ = false;
-  uint32_t inst_ = 0, addr_ = 0;
+  uint32_t inst_ = 0, addr_ = 0, predicted_dest_ = 0;
 
   IUToDecoder() = default;
-  IUToDecoder(bool get_inst, uint32_t inst, uint32_t pc, bool jump);
+  IUToDecoder(bool get_inst, uint32_t inst, uint32_t pc, bool jump, uint32_t predicted_dest);
   IUToDecoder &operator=(const IUToDecoder &other) = default;
 
   std::string ToString() const {
     std::stringstream sstr;
     sstr << std::boolalpha;
     sstr << "{ get_inst_ = " << get_inst_ << ", inst_ = " << inst_ << ", addr_ = " << addr_ << ", is_jump_predicted_ = "
-         << is_jump_predicted_ << " }";
+         << is_jump_predicted_ << ", predicted_dest_ = " << predicted_dest_ << " }";
     return sstr.str();
   }
 };
@@ -142,7 +269,7 @@ struct IUToDecoder {
 struct DecoderOutput {
   InstType inst_type_ = kLUI;
   uint8_t rd_ = 0, rs1_ = 0, rs2_ = 0;
-  uint32_t imm_ = 0, addr_ = 0;
+  uint32_t imm_ = 0, addr_ = 0, predicted_dest_ = 0;
   bool is_jump_predicted_ = false, get_inst_ = false;
 
   std::string ToString() const {
@@ -151,17 +278,36 @@ struct DecoderOutput {
     std::string inst_type_str = inst_map.count(inst_type_) ? inst_map.at(inst_type_) : "No Inst Type";
     sstr << "{ get_inst_ = " << get_inst_ << ", inst_type_ = " << inst_type_str << ", addr_ = " << addr_
          << ", rs1_ = " << (int) rs1_ << ", rs2_ = " << (int) rs2_ << ", rd_ = " << (int) rd_ << ", imm_ = " << imm_
-         << ", is_jump_predicted_ = " << is_jump_predicted_ << " }";
+         << ", is_jump_predicted_ = " << is_jump_predicted_ << ", predicted_dest_ = " << predicted_dest_ << " }";
     return sstr.str();
   }
 };
 
-// store instruction: dest_ = address to store; jump instruction: dest_ = destination of the jump
+// The decoded instructions waiting for dispatch, in program order, of which rs_cnt_ take an entry of the RS and
+// lsb_cnt_ one of the LSB. The longest prefix that fits is dispatched in a cycle and the rest waits for the next one.
+struct DispatchBundle {
+  DecoderOutput inst_[kMaxDispatchWidth];
+  int inst_cnt_ = 0, rs_cnt_ = 0, lsb_cnt_ = 0;
+
+  std::string ToString() const {
+    std::stringstream sstr;
+    sstr << "{ inst_ = {";
+    for (int i = 0; i < inst_cnt_; i++) {
+      sstr << (i == 0 ? " " : ", ") << inst_[i].ToString();
+    }
+    sstr << " }, inst_cnt_ = " << inst_cnt_ << ", rs_cnt_ = " << rs_cnt_ << ", lsb_cnt_ = " << lsb_cnt_ << " }";
+    return sstr.str();
+  }
+};
+
+// store instruction: dest_ = address to store; jump instruction: dest_ = destination of the jump, predicted_dest_ = the
+// destination fetched after it if is_jump_predicted_; is_return_ marks a JALR that returns through x1 or x5
+// violated_ marks a load that read memory before an older store to the same address, which is replayed from its pc.
 struct RoBEntry {
   InstType inst_type_ = kLUI;
-  bool done_ = false, is_jump_predicted_ = false;
+  bool done_ = false, is_jump_predicted_ = false, violated_ = false, is_return_ = false;
   uint8_t rd_ = 0;
-  uint32_t val_ = 0, dest_ = 0, addr_ = 0;
+  uint32_t val_ = 0, dest_ = 0, addr_ = 0, predicted_dest_ = 0;
 
   std::string ToString() const {
     std::stringstream sstr;
@@ -169,24 +315,27 @@ struct RoBEntry {
     std::string inst_type_str = inst_map.count(inst_type_) ? inst_map.at(inst_type_) : "No Inst Type";
     sstr << "{ inst_type_ = " << inst_type_str << ", done_ = " << done_ << ", rd_ = " << (int) rd_
          << ", val_ = " << val_ << ", is_jump_predicted_ = " << is_jump_predicted_ << ", dest_ = " << dest_
-         << ", addr_ = " << addr_ << " }";
+         << ", predicted_dest_ = " << predicted_dest_ << ", addr_ = " << addr_ << ", violated_ = " << violated_
+         << ", is_return_ = " << is_return_ << " }";
     return sstr.str();
   }
 };
 
+// A register write of a committed instruction, whose RoB id is id_.
 struct RobToRF {
   bool write_ = false;
   uint8_t rd_ = 0;
   uint32_t val_ = 0;
+  int id_ = -1;
 
   RobToRF() = default;
-  RobToRF(bool write, uint8_t rd, uint32_t val);
+  RobToRF(bool write, uint8_t rd, uint32_t val, int id);
   RobToRF &operator=(const RobToRF &other) = default;
 
   std::string ToString() const {
     std::stringstream sstr;
     sstr << std::boolalpha;
-    sstr << "{ write_ = " << write_ << ", rd_ = " << (int) rd_ << ", val_ = " << val_ << " }";
+    sstr << "{ write_ = " << write_ << ", rd_ = " << (int) rd_ << ", val_ = " << val_ << ", id_ = " << id_ << " }";
     return sstr.str();
   }
 };
@@ -210,6 +359,19 @@ struct RobToMemory {
   }
 };
 
+// A word of committed stores in the store buffer: the bytes of val_ whose bits are set in mask_ go to the aligned
+// word at addr_.
+struct StoreBufferEntry {
+  uint32_t addr_ = 0, val_ = 0;
+  uint8_t mask_ = 0;
+
+  std::string ToString() const {
+    std::stringstream sstr;
+    sstr << "{ addr_ = " << addr_ << ", val_ = " << val_ << ", mask_ = " << (int) mask_ << " }";
+    return sstr.str();
+  }
+};
+
 struct FlushInfo {
   bool flush_ = false;
   uint32_t pc_ = 0;
@@ -227,25 +389,30 @@ struct FlushInfo {
 };
 
 // If Q1_ == -1, V1_ is the address to load or store. Otherwise, V1_ is the offset.
+// issued_ marks a load that has been sent to the memory ahead of older entries and leaves once it reaches the front.
+// pc_ is the address of the instruction and dep_id_ the RoB id of the store a load waits for, or -1.
 struct LSBEntry {
   InstType inst_type_ = kLUI;
-  int id_ = 0, Q1_ = -1, Q2_ = -1;
-  uint32_t V1_ = 0, V2_ = 0;
+  int id_ = 0, Q1_ = -1, Q2_ = -1, dep_id_ = -1;
+  uint32_t V1_ = 0, V2_ = 0, pc_ = 0;
+  bool issued_ = false;
 
   std::string ToString() const {
     std::stringstream sstr;
     sstr << std::boolalpha;
     std::string inst_type_str = inst_map.count(inst_type_) ? inst_map.at(inst_type_) : "No Inst Type";
     sstr << "{ inst_type_ = " << inst_type_str << ", id_ = " << id_ << ", Q1_ = " << Q1_ << ", V1_ = " << V1_
-         << ", Q2_ = " << Q2_ << ", V2_ = " << V2_ << " }";
+         << ", Q2_ = " << Q2_ << ", V2_ = " << V2_ << ", issued_ = " << issued_ << ", pc_ = " << pc_
+         << ", dep_id_ = " << dep_id_ << " }";
     return sstr.str();
   }
 };
 
+// A forwarded load carries the data of an older store in val_ and does not read the memory.
 struct LSBToMemory {
   InstType inst_type_ = kLUI;
-  bool load_ = false;
-  uint32_t load_addr_ = 0;
+  bool load_ = false, forwarded_ = false;
+  uint32_t load_addr_ = 0, val_ = 0;
   int id_ = 0;
 
   std::string ToString() const {
@@ -253,7 +420,7 @@ struct LSBToMemory {
     sstr << std::boolalpha;
     std::string inst_type_str = inst_map.count(inst_type_) ? inst_map.at(inst_type_) : "No Inst Type";
     sstr << "{ load_ = " << load_ << ", id_ = " << id_ << ", load_addr_ = " << load_addr_ << ", inst_type_ = "
-         << inst_type_str << " }";
+         << inst_type_str << ", forwarded_ = " << forwarded_ << ", val_ = " << val_ << " }";
     return sstr.str();
   }
 };
@@ -272,32 +439,41 @@ struct RSEntry {
   }
 };
 
+// An operation issued to a functional unit, whose result is broadcast latency_ cycles after the unit starts it.
 struct RSToALU {
   bool execute_ = false;
   ALUOpType alu_op_type_ = kAdd;
   uint32_t in1_ = 0, in2_ = 0;
   int id_ = 0;
+  int latency_ = 1;
 
   std::string ToString() const {
     std::stringstream sstr;
     sstr << std::boolalpha;
     sstr << "{ execute_ = " << execute_ << ", alu_op_type_ = " << alu_map.at(alu_op_type_) << ", id_ = " << id_
-         << ", in1_ = " << in1_ << ", in2_ = " << in2_ << " }";
+         << ", in1_ = " << in1_ << ", in2_ = " << in2_ << ", latency_ = " << latency_ << " }";
     return sstr.str();
   }
 };
 
+// The inst_cnt_ instructions at pc_, pc_ + 4 and so on. stall_ tells that the memory is fetching the instructions
+// requested last and ignores new requests meanwhile.
 struct MemoryToIU {
-  uint32_t inst_ = 0, pc_ = 0;
+  uint32_t inst_[kMaxFetchWidth] = {}, pc_ = 0;
+  int inst_cnt_ = 0;
+  bool stall_ = false;
 
   MemoryToIU() = default;
-  MemoryToIU(uint32_t inst, uint32_t pc);
   MemoryToIU &operator=(const MemoryToIU &other) = default;
 
   std::string ToString() const {
     std::stringstream sstr;
     sstr << std::boolalpha;
-    sstr << "{ inst_ = " << inst_ << ", pc_ = " << pc_ << " }";
+    sstr << "{ inst_ = {";
+    for (int i = 0; i < inst_cnt_; i++) {
+      sstr << (i == 0 ? " " : ", ") << inst_[i];
+    }
+    sstr << " }, pc_ = " << pc_ << ", inst_cnt_ = " << inst_cnt_ << ", stall_ = " << stall_ << " }";
     return sstr.str();
   };
 };
@@ -0,0 +1,66 @@
+#ifndef RISC_V_SIMULATOR_BITOPERATION_H
+#define RISC_V_SIMULATOR_BITOPERATION_H
+
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace bubble {
+
+inline int PopCount(uint64_t n) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(n);
+#else
+  int cnt = 0;
+  for (; n != 0; n &= n - 1) {
+    cnt++;
+  }
+  return cnt;
+#endif
+}
+
+// The index of the lowest set bit of n, which is not 0.
+inline int CountTrailingZeros(uint64_t n) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(n);
+#else
+  int cnt = 0;
+  for (; !(n & 1); n >>= 1) {
+    cnt++;
+  }
+  return cnt;
+#endif
+}
+
+/*
+ * Bit i of the result is set if tags[i] == tag, for i in [0, cnt) with cnt <= 64. The tags are compared 8 at a time
+ * with AVX2 or 4 at a time with SSE2 if the target has them and one by one otherwise, so tags has to be readable up to
+ * cnt rounded up to a multiple of 8, and the bits from cnt on are unspecified.
+ */
+inline uint64_t MatchTags(const int *tags, int tag, int cnt) {
+  uint64_t mask = 0;
+#if defined(__AVX2__)
+  __m256i key = _mm256_set1_epi32(tag);
+  for (int i = 0; i < cnt; i += 8) {
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + i)), key);
+    mask |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) << i;
+  }
+#elif defined(__SSE2__)
+  __m128i key = _mm_set1_epi32(tag);
+  for (int i = 0; i < cnt; i += 4) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(tags + i)), key);
+    mask |= static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(eq))) << i;
+  }
+#else
+  for (int i = 0; i < cnt; i++) {
+    mask |= static_cast<uint64_t>(tags[i] == tag) << i;
+  }
+#endif
+  return mask;
+}
+
+}
+
+#endif //RISC_V_SIMULATOR_BITOPERATION_H
@@ -6,13 +6,22 @@
 
 namespace bubble {
 
+template<class T>
+class Register;
+
+// A queue of at most capacity elements, whose actual capacity can be lowered with SetCapacity() while it is empty.
 template<class T, int capacity>
 class CircularQueue {
  public:
   CircularQueue() = default;
+  explicit CircularQueue(int cur_capacity);
   CircularQueue(const std::array<T, capacity + 1> &arr, int front, int rear);
   CircularQueue &operator=(const CircularQueue &other) = default;
 
+  int Capacity() const;
+  void SetCapacity(int cur_capacity);
+  int Next(int index) const;
+  int Prev(int index) const;
   bool IsEmpty() const;
   bool IsFull() const;
   void Enqueue(const T &x);
@@ -29,10 +38,19 @@ class CircularQueue {
   int Size() const;
 
  private:
+  template<class U>
+  friend class Register;
+
   T data_[capacity + 1];
   int front_, rear_; // [front_, rear_)
+  int capacity_ = capacity;
 };
 
+template<class T, int capacity>
+CircularQueue<T, capacity>::CircularQueue(int cur_capacity) : data_(), front_(0), rear_(0), capacity_(cur_capacity) {
+  assert(cur_capacity >= 1 && cur_capacity <= capacity);
+}
+
 template<class T, int capacity>
 CircularQueue<T, capacity>::CircularQueue(const std::array<T, capacity + 1> &arr, int front, int rear) :
     front_(front), rear_(rear), data_() {
@@ -41,6 +59,28 @@ CircularQueue<T, capacity>::CircularQueue(const std::array<T, capacity + 1> &arr
   }
 }
 
+template<class T, int capacity>
+int CircularQueue<T, capacity>::Capacity() const {
+  return capacity_;
+}
+
+template<class T, int capacity>
+void CircularQueue<T, capacity>::SetCapacity(int cur_capacity) {
+  assert(IsEmpty() && cur_capacity >= 1 && cur_capacity <= capacity);
+  capacity_ = cur_capacity;
+  front_ = rear_ = 0;
+}
+
+template<class T, int capacity>
+int CircularQueue<T, capacity>::Next(int index) const {
+  return index == capacity_ ? 0 : index + 1;
+}
+
+template<class T, int capacity>
+int CircularQueue<T, capacity>::Prev(int index) const {
+  return index == 0 ? capacity_ : index - 1;
+}
+
 template<class T, int capacity>
 bool CircularQueue<T, capacity>::IsEmpty() const {
   return front_ == rear_;
@@ -48,18 +88,18 @@ bool CircularQueue<T, capacity>::IsEmpty() const {
 
 template<class T, int capacity>
 bool CircularQueue<T, capacity>::IsFull() const {
-  return front_ == (rear_ + 1) % (capacity + 1);
+  return front_ == Next(rear_);
 }
 
 template<class T, int capacity>
 void CircularQueue<T, capacity>::Enqueue(const T &x) {
   data_[rear_] = x;
-  rear_ = (rear_ + 1) % (capacity + 1);
+  rear_ = Next(rear_);
 }
 
 template<class T, int capacity>
 void CircularQueue<T, capacity>::Dequeue() {
-  front_ = (front_ + 1) % (capacity + 1);
+  front_ = Next(front_);
 }
 
 template<class T, int capacity>
@@ -74,12 +114,12 @@ const T &CircularQueue<T, capacity>::Front() const {
 
 template<class T, int capacity>
 T &CircularQueue<T, capacity>::Back() {
-  return data_[rear_ == 0 ? capacity : rear_ - 1];
+  return data_[Prev(rear_)];
 }
 
 template<class T, int capacity>
 const T &CircularQueue<T, capacity>::Back() const {
-  return data_[rear_ == 0 ? capacity : rear_ - 1];
+  return data_[Prev(rear_)];
 }
 
 template<class T, int capacity>
@@ -112,7 +152,7 @@ int CircularQueue<T, capacity>::Size() const {
   if (rear_ >= front_) {
     return rear_ - front_;
   }
-  return capacity - front_ + 1 + rear_;
+  return capacity_ - front_ + 1 + rear_;
 }
 
 }
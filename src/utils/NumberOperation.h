@@ -1,7 +1,11 @@
 #ifndef RISC_V_SIMULATOR_NUMBEROPERATION_H
 #define RISC_V_SIMULATOR_NUMBEROPERATION_H
 
+#include <cctype>
 #include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
 
 namespace bubble {
 
@@ -21,6 +25,32 @@ constexpr uint32_t SignExtend(uint32_t n, int start) {
   return (n >> start) ? (n | static_cast<uint32_t>(-1) << (start + 1)) : n;
 }
 
+// Whether all of str is an unsigned number in base that fits in num, which is set to it if so. std::stoull would
+// skip leading spaces and wrap a minus sign around, so str has to start with a digit.
+template<typename T>
+bool ParseNumber(const std::string &str, T &num, int base = 10) {
+  auto first = static_cast<unsigned char>(str.empty() ? ' ' : str[0]);
+  if (base == 16 ? !std::isxdigit(first) : !std::isdigit(first)) {
+    return false;
+  }
+  unsigned long long value;
+  try {
+    std::size_t pos;
+    value = std::stoull(str, &pos, base);
+    if (pos != str.size()) {
+      return false;
+    }
+  }
+  catch (const std::exception &) {
+    return false;
+  }
+  if (value > std::numeric_limits<T>::max()) {
+    return false;
+  }
+  num = static_cast<T>(value);
+  return true;
+}
+
 }
 
 #endif //RISC_V_SIMULATOR_NUMBEROPERATION_H
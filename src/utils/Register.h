@@ -1,8 +1,19 @@
 #ifndef RISC_V_SIMULATOR_REGISTER_H
 #define RISC_V_SIMULATOR_REGISTER_H
 
+#include <array>
+#include <iostream>
+
+#include "CircularQueue.h"
+#include "Serialization.h"
+
 namespace bubble {
 
+/*
+ * GetCur() is the value of the register in this cycle and New() is the value it will hold in the next cycle.
+ * Update() only copies new_ into cur_ if the register was written through New() or Write() since the last Update().
+ * Use GetNew() to read new_ without marking the register as written.
+ */
 template<class T>
 class Register {
  public:
@@ -13,13 +24,17 @@ class Register {
   void Write(const T &src);
   T &New();
   const T &New() const;
+  const T &GetNew() const;
   const T &GetCur() const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
 #ifdef _DEBUG
  private:
 #else
  public:
 #endif
   T cur_, new_;
+  bool dirty_ = false;
 };
 
 template<class T>
@@ -27,16 +42,22 @@ Register<T>::Register(const T &data) : cur_(data), new_(data) {}
 
 template<class T>
 void Register<T>::Update() {
+  if (!dirty_) {
+    return;
+  }
   cur_ = new_;
+  dirty_ = false;
 }
 
 template<class T>
 void Register<T>::Write(const T &src) {
   new_ = src;
+  dirty_ = true;
 }
 
 template<class T>
 T &Register<T>::New() {
+  dirty_ = true;
   return new_;
 }
 
@@ -45,11 +66,280 @@ const T &Register<T>::New() const {
   return new_;
 }
 
+template<class T>
+const T &Register<T>::GetNew() const {
+  return new_;
+}
+
 template<class T>
 const T &Register<T>::GetCur() const {
   return cur_;
 }
 
+template<class T>
+void Register<T>::Serialize(std::ostream &out) const {
+  WriteBinary(out, cur_);
+  WriteBinary(out, new_);
+}
+
+template<class T>
+void Register<T>::Deserialize(std::istream &in) {
+  ReadBinary(in, cur_);
+  ReadBinary(in, new_);
+  dirty_ = true;
+}
+
+/*
+ * Double buffer of slot_cnt slots that remembers which slots of new_ were written since the last Update(), so that
+ * Update() copies only those slots instead of the whole buffer. The cost of a cycle then depends on the number of
+ * slots written, not on the size of the buffer.
+ */
+template<class Buffer, int slot_cnt>
+class SlotRegister {
+ public:
+  SlotRegister() = default;
+  explicit SlotRegister(const Buffer &data);
+
+  void Write(const Buffer &src);
+  const Buffer &New() const;
+  const Buffer &GetNew() const;
+  const Buffer &GetCur() const;
+  void Serialize(std::ostream &out) const;
+  void Deserialize(std::istream &in);
+
+ protected:
+  void MarkDirty(int index);
+  void UpdateSlots();
+
+  Buffer cur_, new_;
+  bool is_dirty_[slot_cnt] = {}, all_dirty_ = false;
+  int dirty_ids_[slot_cnt] = {}, dirty_cnt_ = 0;
+};
+
+template<class Buffer, int slot_cnt>
+SlotRegister<Buffer, slot_cnt>::SlotRegister(const Buffer &data) : cur_(data), new_(data) {}
+
+template<class Buffer, int slot_cnt>
+void SlotRegister<Buffer, slot_cnt>::Write(const Buffer &src) {
+  new_ = src;
+  all_dirty_ = true;
+}
+
+template<class Buffer, int slot_cnt>
+const Buffer &SlotRegister<Buffer, slot_cnt>::New() const {
+  return new_;
+}
+
+template<class Buffer, int slot_cnt>
+const Buffer &SlotRegister<Buffer, slot_cnt>::GetNew() const {
+  return new_;
+}
+
+template<class Buffer, int slot_cnt>
+const Buffer &SlotRegister<Buffer, slot_cnt>::GetCur() const {
+  return cur_;
+}
+
+template<class Buffer, int slot_cnt>
+void SlotRegister<Buffer, slot_cnt>::Serialize(std::ostream &out) const {
+  WriteBinary(out, cur_);
+  WriteBinary(out, new_);
+}
+
+template<class Buffer, int slot_cnt>
+void SlotRegister<Buffer, slot_cnt>::Deserialize(std::istream &in) {
+  ReadBinary(in, cur_);
+  ReadBinary(in, new_);
+  all_dirty_ = true;
+}
+
+template<class Buffer, int slot_cnt>
+void SlotRegister<Buffer, slot_cnt>::MarkDirty(int index) {
+  if (!is_dirty_[index]) {
+    is_dirty_[index] = true;
+    dirty_ids_[dirty_cnt_++] = index;
+  }
+}
+
+template<class Buffer, int slot_cnt>
+void SlotRegister<Buffer, slot_cnt>::UpdateSlots() {
+  if (all_dirty_) {
+    cur_ = new_;
+  }
+  else {
+    for (int i = 0; i < dirty_cnt_; i++) {
+      cur_[dirty_ids_[i]] = new_[dirty_ids_[i]];
+    }
+  }
+  for (int i = 0; i < dirty_cnt_; i++) {
+    is_dirty_[dirty_ids_[i]] = false;
+  }
+  dirty_cnt_ = 0;
+  all_dirty_ = false;
+}
+
+template<class T, int capacity>
+class Register<CircularQueue<T, capacity>> : public SlotRegister<CircularQueue<T, capacity>, capacity + 1> {
+ public:
+  // Write access to new_ that marks every slot it hands out as dirty.
+  class Writer {
+   public:
+    explicit Writer(Register &reg);
+
+    bool IsEmpty() const;
+    bool IsFull() const;
+    void Enqueue(const T &x);
+    void Dequeue();
+    T &Front();
+    T &Back();
+    int BeginId() const;
+    int EndId() const;
+    T &operator[](int index);
+    void Clear();
+    int Size() const;
+
+   private:
+    Register *reg_;
+  };
+
+  Register() = default;
+  explicit Register(const CircularQueue<T, capacity> &data);
+
+  void Update();
+  using SlotRegister<CircularQueue<T, capacity>, capacity + 1>::New;
+  Writer New();
+};
+
+template<class T, int capacity>
+Register<CircularQueue<T, capacity>>::Writer::Writer(Register &reg) : reg_(&reg) {}
+
+template<class T, int capacity>
+bool Register<CircularQueue<T, capacity>>::Writer::IsEmpty() const {
+  return reg_->new_.IsEmpty();
+}
+
+template<class T, int capacity>
+bool Register<CircularQueue<T, capacity>>::Writer::IsFull() const {
+  return reg_->new_.IsFull();
+}
+
+template<class T, int capacity>
+void Register<CircularQueue<T, capacity>>::Writer::Enqueue(const T &x) {
+  reg_->MarkDirty(reg_->new_.EndId());
+  reg_->new_.Enqueue(x);
+}
+
+template<class T, int capacity>
+void Register<CircularQueue<T, capacity>>::Writer::Dequeue() {
+  reg_->new_.Dequeue();
+}
+
+template<class T, int capacity>
+T &Register<CircularQueue<T, capacity>>::Writer::Front() {
+  reg_->MarkDirty(reg_->new_.BeginId());
+  return reg_->new_.Front();
+}
+
+template<class T, int capacity>
+T &Register<CircularQueue<T, capacity>>::Writer::Back() {
+  reg_->MarkDirty(reg_->new_.Prev(reg_->new_.EndId()));
+  return reg_->new_.Back();
+}
+
+template<class T, int capacity>
+int Register<CircularQueue<T, capacity>>::Writer::BeginId() const {
+  return reg_->new_.BeginId();
+}
+
+template<class T, int capacity>
+int Register<CircularQueue<T, capacity>>::Writer::EndId() const {
+  return reg_->new_.EndId();
+}
+
+template<class T, int capacity>
+T &Register<CircularQueue<T, capacity>>::Writer::operator[](int index) {
+  reg_->MarkDirty(index);
+  return reg_->new_[index];
+}
+
+template<class T, int capacity>
+void Register<CircularQueue<T, capacity>>::Writer::Clear() {
+  reg_->new_.Clear();
+}
+
+template<class T, int capacity>
+int Register<CircularQueue<T, capacity>>::Writer::Size() const {
+  return reg_->new_.Size();
+}
+
+template<class T, int capacity>
+Register<CircularQueue<T, capacity>>::Register(const CircularQueue<T, capacity> &data) :
+    SlotRegister<CircularQueue<T, capacity>, capacity + 1>(data) {}
+
+template<class T, int capacity>
+void Register<CircularQueue<T, capacity>>::Update() {
+  this->UpdateSlots();
+  this->cur_.front_ = this->new_.front_;
+  this->cur_.rear_ = this->new_.rear_;
+  this->cur_.capacity_ = this->new_.capacity_;
+}
+
+template<class T, int capacity>
+typename Register<CircularQueue<T, capacity>>::Writer Register<CircularQueue<T, capacity>>::New() {
+  return Writer(*this);
+}
+
+template<class T, std::size_t size>
+class Register<std::array<T, size>> : public SlotRegister<std::array<T, size>, size> {
+ public:
+  // Write access to new_ that marks every slot it hands out as dirty.
+  class Writer {
+   public:
+    explicit Writer(Register &reg);
+
+    T &operator[](std::size_t index);
+    std::size_t Size() const;
+
+   private:
+    Register *reg_;
+  };
+
+  Register() = default;
+  explicit Register(const std::array<T, size> &data);
+
+  void Update();
+  using SlotRegister<std::array<T, size>, size>::New;
+  Writer New();
+};
+
+template<class T, std::size_t size>
+Register<std::array<T, size>>::Writer::Writer(Register &reg) : reg_(&reg) {}
+
+template<class T, std::size_t size>
+T &Register<std::array<T, size>>::Writer::operator[](std::size_t index) {
+  reg_->MarkDirty(index);
+  return reg_->new_[index];
+}
+
+template<class T, std::size_t size>
+std::size_t Register<std::array<T, size>>::Writer::Size() const {
+  return size;
+}
+
+template<class T, std::size_t size>
+Register<std::array<T, size>>::Register(const std::array<T, size> &data) :
+    SlotRegister<std::array<T, size>, size>(data) {}
+
+template<class T, std::size_t size>
+void Register<std::array<T, size>>::Update() {
+  this->UpdateSlots();
+}
+
+template<class T, std::size_t size>
+typename Register<std::array<T, size>>::Writer Register<std::array<T, size>>::New() {
+  return Writer(*this);
+}
+
 }
 
 #endif //RISC_V_SIMULATOR_REGISTER_H
@@ -0,0 +1,27 @@
+#ifndef RISC_V_SIMULATOR_SERIALIZATION_H
+#define RISC_V_SIMULATOR_SERIALIZATION_H
+
+#include <iostream>
+#include <type_traits>
+
+namespace bubble {
+
+/*
+ * Raw binary (de)serialization of trivially copyable values, used for checkpoints. The layout is that of the host, so a
+ * checkpoint can only be restored by a build of the same simulator on the same kind of machine.
+ */
+template<class T>
+void WriteBinary(std::ostream &out, const T &data) {
+  static_assert(std::is_trivially_copyable<T>::value, "WriteBinary needs a trivially copyable type");
+  out.write(reinterpret_cast<const char *>(&data), sizeof(T));
+}
+
+template<class T>
+void ReadBinary(std::istream &in, T &data) {
+  static_assert(std::is_trivially_copyable<T>::value, "ReadBinary needs a trivially copyable type");
+  in.read(reinterpret_cast<char *>(&data), sizeof(T));
+}
+
+}
+
+#endif //RISC_V_SIMULATOR_SERIALIZATION_H
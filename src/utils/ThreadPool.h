@@ -0,0 +1,96 @@
+#ifndef RISC_V_SIMULATOR_THREADPOOL_H
+#define RISC_V_SIMULATOR_THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace bubble {
+
+/*
+ * Fixed number of worker threads that run submitted tasks in submission order. Wait() blocks until every submitted task
+ * has finished; the destructor waits as well and then stops the workers.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(unsigned thread_cnt);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  void Submit(std::function<void()> task);
+  void Wait();
+
+ private:
+  void Work();
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable task_cv_, idle_cv_;
+  unsigned running_cnt_;
+  bool stop_;
+};
+
+inline ThreadPool::ThreadPool(unsigned thread_cnt) : workers_(), tasks_(), running_cnt_(0), stop_(false) {
+  if (thread_cnt == 0) {
+    thread_cnt = 1;
+  }
+  for (unsigned i = 0; i < thread_cnt; i++) {
+    workers_.emplace_back([this]() { Work(); });
+  }
+}
+
+inline ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+inline void ThreadPool::Submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push(std::move(task));
+  }
+  task_cv_.notify_one();
+}
+
+inline void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cv_.wait(lock, [this]() { return tasks_.empty() && running_cnt_ == 0; });
+}
+
+inline void ThreadPool::Work() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+      running_cnt_++;
+    }
+    task();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_cnt_--;
+    }
+    idle_cv_.notify_all();
+  }
+}
+
+}
+
+#endif //RISC_V_SIMULATOR_THREADPOOL_H
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "src/utils/NumberOperation.h"
+#include "src/utils/ThreadPool.h"
+
+#include "src/CPU.h"
+
+// Runs every program on every point of a grid of core configurations, one CPU per task on a pool of worker threads, and
+// prints a table with one row per program and point: name, the value of each grid axis, output, cycles, committed
+// instructions, CPI, branch prediction accuracy, the share of speculative loads that were replayed and the miss rate of
+// each cache ("-" if the cache is left out). Each program is parsed once and its image is shared by all of its runs.
+// Options: -j n sets the number of threads (default: number of cores), --dir=path runs every .data file in path
+// (default: testcases when no file is given), --output=path writes the table to path instead of stdout,
+// --config=path sets the configuration the grid starts from, and --key=a,b,... adds a grid axis over the values a, b,
+// ... of a parameter of Config::Set(), written with '-' for '_' (e.g. --rob-size=16,32,64 --bp-size=64,256). Any other
+// argument is a .data file to run.
+struct SweepAxis {
+  std::string key;
+  std::vector<std::string> values;
+};
+
+struct SweepResult {
+  uint32_t output = 0, cycle_cnt = 0;
+  uint64_t commit_cnt = 0;
+  double accuracy = 0, violation_rate = 0;
+  // The miss rates of L1I, L1D and L2, or -1 if the cache is left out.
+  double miss_rates[3] = {};
+};
+
+int main(int argc, char *argv[]) {
+  unsigned thread_cnt = std::thread::hardware_concurrency();
+  std::vector<std::string> paths;
+  std::string dir, output_path;
+  bubble::Config base_config;
+  std::vector<SweepAxis> axes;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      if (!bubble::ParseNumber(argv[++i], thread_cnt)) {
+        std::cerr << "invalid option -j " << argv[i] << "\n";
+        return 1;
+      }
+    }
+    else if (arg.rfind("--dir=", 0) == 0) {
+      dir = arg.substr(6);
+    }
+    else if (arg.rfind("--output=", 0) == 0) {
+      output_path = arg.substr(9);
+    }
+    else if (arg.rfind("--config=", 0) == 0) {
+      if (!base_config.ParseArgument(arg)) {
+        std::cerr << "invalid option " << arg << "\n";
+        return 1;
+      }
+    }
+    else if (arg.rfind("--", 0) == 0 && arg.find('=') != std::string::npos) {
+      SweepAxis axis;
+      axis.key = arg.substr(2, arg.find('=') - 2);
+      std::replace(axis.key.begin(), axis.key.end(), '-', '_');
+      std::istringstream values(arg.substr(arg.find('=') + 1));
+      std::string value;
+      while (std::getline(values, value, ',')) {
+        bubble::Config config;
+        if (!config.Set(axis.key, value)) {
+          std::cerr << "invalid value " << value << " in " << arg << "\n";
+          return 1;
+        }
+        axis.values.push_back(value);
+      }
+      if (axis.values.empty()) {
+        std::cerr << "invalid option " << arg << "\n";
+        return 1;
+      }
+      axes.push_back(axis);
+    }
+    else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty() && dir.empty()) {
+    dir = "testcases";
+  }
+  if (!dir.empty()) {
+    std::vector<std::string> dir_paths;
+    for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+      if (entry.path().extension() == ".data") {
+        dir_paths.push_back(entry.path().string());
+      }
+    }
+    std::sort(dir_paths.begin(), dir_paths.end());
+    paths.insert(paths.end(), dir_paths.begin(), dir_paths.end());
+  }
+  std::vector<bubble::MemoryImage> images;
+  for (const auto &path : paths) {
+    std::ifstream in(path);
+    if (!std::filesystem::is_regular_file(path) || !in) {
+      std::cerr << "cannot open " << path << "\n";
+      return 1;
+    }
+    images.push_back(bubble::Memory::ParseImage(in));
+  }
+  // The cross product of the axes, the last axis varying fastest.
+  std::vector<std::vector<std::string>> points(1);
+  for (const auto &axis : axes) {
+    std::vector<std::vector<std::string>> new_points;
+    for (const auto &point : points) {
+      for (const auto &value : axis.values) {
+        new_points.push_back(point);
+        new_points.back().push_back(value);
+      }
+    }
+    points = std::move(new_points);
+  }
+  std::vector<bubble::Config> configs;
+  for (const auto &point : points) {
+    bubble::Config config = base_config;
+    for (std::size_t i = 0; i < axes.size(); i++) {
+      config.Set(axes[i].key, point[i]);
+    }
+    configs.push_back(config);
+  }
+  std::vector<SweepResult> results(paths.size() * configs.size());
+  {
+    bubble::ThreadPool pool(thread_cnt);
+    for (std::size_t i = 0; i < results.size(); i++) {
+      pool.Submit([&image = images[i / configs.size()], &config = configs[i % configs.size()],
+                      &result = results[i]]() {
+        bubble::CPU cpu(config);
+        cpu.LoadMemory(image);
+        cpu.clock_.Run();
+        while (!cpu.ShouldHalt()) {
+          cpu.Step();
+        }
+        result.output = cpu.Halt();
+        result.cycle_cnt = cpu.clock_.GetCycleCount();
+        result.commit_cnt = cpu.rb_.GetCommitCount();
+        result.accuracy = cpu.bp_.GetAccuracy();
+        result.violation_rate = cpu.ssp_.GetViolationRate();
+        const bubble::Cache *caches[] = {&cpu.memory_.GetL1ICache(), &cpu.memory_.GetL1DCache(),
+                                         &cpu.memory_.GetL2Cache()};
+        for (int j = 0; j < 3; j++) {
+          result.miss_rates[j] = (caches[j]->IsEnabled() ? caches[j]->GetMissRate() : -1);
+        }
+      });
+    }
+  }
+  std::ofstream output_file;
+  if (!output_path.empty()) {
+    output_file.open(output_path);
+    if (!output_file) {
+      std::cerr << "cannot open " << output_path << "\n";
+      return 1;
+    }
+  }
+  std::ostream &out = output_path.empty() ? std::cout : output_file;
+  out << std::left << std::setw(16) << "program" << std::right;
+  for (const auto &axis : axes) {
+    out << std::setw(std::max<int>(axis.key.size(), 6) + 2) << axis.key;
+  }
+  out << std::setw(8) << "output" << std::setw(12) << "cycles" << std::setw(12) << "insts" << std::setw(8) << "CPI"
+      << std::setw(10) << "accuracy" << std::setw(10) << "ld_replay" << std::setw(10) << "l1i_miss" << std::setw(10)
+      << "l1d_miss" << std::setw(10) << "l2_miss" << "\n";
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const auto &result = results[i];
+    out << std::left << std::setw(16) << std::filesystem::path(paths[i / configs.size()]).stem().string()
+        << std::right;
+    for (std::size_t j = 0; j < axes.size(); j++) {
+      out << std::setw(std::max<int>(axes[j].key.size(), 6) + 2) << points[i % configs.size()][j];
+    }
+    double cpi = result.commit_cnt == 0 ? 0 : static_cast<double>(result.cycle_cnt) / result.commit_cnt;
+    out << std::setw(8) << result.output << std::setw(12) << result.cycle_cnt << std::setw(12) << result.commit_cnt
+        << std::fixed << std::setprecision(4) << std::setw(8) << cpi << std::setw(10) << result.accuracy
+        << std::setw(10) << result.violation_rate;
+    for (double miss_rate : result.miss_rates) {
+      if (miss_rate < 0) {
+        out << std::setw(10) << "-";
+      }
+      else {
+        out << std::setw(10) << miss_rate;
+      }
+    }
+    out << "\n";
+  }
+  return 0;
+}